@@ -5,13 +5,30 @@ let () =
   if Array.length Sys.argv < 2 then (
     Printf.eprintf "Please provide some files as arguments.\n%!";
     exit 1 );
-  let bin = Element_factory.make "playbin" "play" in
-  let play fileName =
-    Element.set_property_string bin "uri" ("file://" ^ fileName);
-    Element.set_state bin Element.State_playing |> ignore;
-    Bus.timed_pop_filtered (Bus.of_element bin) [`End_of_stream] |> ignore;
-    Element.set_state bin Element.State_null |> ignore
+  let files = Array.to_list Sys.argv |> List.tl in
+  let playlist = Playlist.create () in
+  let pipeline = Playlist.pipeline playlist in
+  let bus = Bus.of_element pipeline in
+  (* Enqueue the first two files and the following ones as soon as the
+     previous one starts playing, so that they are prerolled in time. *)
+  let enqueue = function
+    | [] -> []
+    | file :: files ->
+        Playlist.enqueue playlist ("file://" ^ file);
+        files
   in
-  Array.to_list Sys.argv |> List.tl |> List.iter play;
+  let files = ref (enqueue files) in
+  files := enqueue !files;
+  Element.set_state pipeline Element.State_playing |> ignore;
+  let rec loop () =
+    let msg = Bus.timed_pop_filtered bus [`End_of_stream; `Stream_start] in
+    match msg.Bus.payload with
+      | `Stream_start ->
+          files := enqueue !files;
+          loop ()
+      | _ -> ()
+  in
+  loop ();
+  Element.set_state pipeline Element.State_null |> ignore;
   Gstreamer.deinit ();
   Gc.full_major ()
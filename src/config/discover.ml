@@ -22,5 +22,11 @@ let () =
                 | None -> default
                 | Some deps -> deps )
       in
-      C.Flags.write_sexp "c_flags.sexp" conf.cflags;
+      (* Let the compiler vectorize the loops of the Dsp module. *)
+      let vectorize =
+        if C.c_test c ~c_flags:["-ftree-vectorize"] "int main() { return 0; }"
+        then ["-ftree-vectorize"]
+        else []
+      in
+      C.Flags.write_sexp "c_flags.sexp" (conf.cflags @ vectorize);
       C.Flags.write_sexp "c_library_flags.sexp" conf.libs)
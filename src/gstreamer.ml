@@ -11,9 +11,32 @@ let () =
   Callback.register_exception "gstreamer_exn_failed" Failed;
   Callback.register_exception "gstreamer_exn_eos" End_of_stream
 
+(* Release OCaml values which are not referenced by GStreamer anymore. *)
+external collect_roots : unit -> unit = "ocaml_gstreamer_collect_roots"
+
+let (_ : Gc.alarm) = Gc.create_alarm collect_roots
+
 external init : string array option -> unit = "ocaml_gstreamer_init"
 
-let init ?argv () = init argv
+external registry_fork_set_enabled : bool -> unit
+  = "ocaml_gstreamer_registry_fork_set_enabled"
+
+let init ?argv ?registry_fork ?registry_update ?registry ?plugin_path () =
+  (match registry_fork with
+    | Some b -> registry_fork_set_enabled b
+    | None -> ());
+  (match registry_update with
+    | Some b -> Unix.putenv "GST_REGISTRY_UPDATE" (if b then "yes" else "no")
+    | None -> ());
+  (match registry with
+    | Some f -> Unix.putenv "GST_REGISTRY_1_0" f
+    | None -> ());
+  (match plugin_path with
+    | Some l ->
+        let sep = if Sys.win32 then ";" else ":" in
+        Unix.putenv "GST_PLUGIN_SYSTEM_PATH_1_0" (String.concat sep l)
+    | None -> ());
+  init argv
 
 external deinit : unit -> unit = "ocaml_gstreamer_deinit"
 external version : unit -> int * int * int * int = "ocaml_gstreamer_version"
@@ -41,6 +64,57 @@ module Event = struct
     | Seek_flag_snap_nearest
 end
 
+module Caps = struct
+  type t
+
+  external to_string : t -> string = "ocaml_gstreamer_caps_to_string"
+  external of_string : string -> t = "ocaml_gstreamer_caps_of_string"
+
+  type field_value =
+    | Int of int
+    | Double of float
+    | Bool of bool
+    | String of string
+    | Fraction of int * int
+
+  external make : string -> (string * field_value) array -> t
+    = "ocaml_gstreamer_caps_make"
+
+  let make name fields = make name (Array.of_list fields)
+
+  let audio_raw ~format ~rate ~channels =
+    make "audio/x-raw"
+      [
+        ("format", String format);
+        ("layout", String "interleaved");
+        ("rate", Int rate);
+        ("channels", Int channels);
+      ]
+
+  let video_raw ~format ~width ~height ~framerate:(num, den) =
+    make "video/x-raw"
+      [
+        ("format", String format);
+        ("width", Int width);
+        ("height", Int height);
+        ("framerate", Fraction (num, den));
+      ]
+
+  external size : t -> int = "ocaml_gstreamer_caps_size"
+  external name : t -> int -> string = "ocaml_gstreamer_caps_name"
+
+  let name ?(index = 0) c = name c index
+
+  external get_field : t -> int -> string -> field_value
+    = "ocaml_gstreamer_caps_get_field"
+
+  let get_field ?(index = 0) c field = get_field c index field
+
+  external is_fixed : t -> bool = "ocaml_gstreamer_caps_is_fixed"
+  external is_empty : t -> bool = "ocaml_gstreamer_caps_is_empty"
+  external intersect : t -> t -> t = "ocaml_gstreamer_caps_intersect"
+end
+
 module Element = struct
   type t
 
@@ -53,6 +127,32 @@ module Element = struct
   external set_property_bool : t -> string -> string -> unit
     = "ocaml_gstreamer_element_set_property_bool"
 
+  type property_value =
+    | Int of int
+    | Int64 of Int64.t
+    | Uint64 of Int64.t
+    | Double of float
+    | Bool of bool
+    | String of string
+    | Enum of int
+    | Caps of Caps.t
+
+  external set_property : t -> string -> property_value -> unit
+    = "ocaml_gstreamer_element_set_property"
+
+  external get_property : t -> string -> property_value
+    = "ocaml_gstreamer_element_get_property"
+
+  external set_properties_many :
+    (t * (string * property_value) array) array -> unit
+    = "ocaml_gstreamer_element_set_properties_many"
+
+  let set_properties_many l =
+    set_properties_many
+      (Array.of_list (List.map (fun (e, p) -> (e, Array.of_list p)) l))
+
+  let set_properties e p = set_properties_many [(e, p)]
+
   type state =
     | State_void_pending
     | State_null
@@ -85,6 +185,11 @@ module Element = struct
            e')
          e ee)
 
+  external unlink : t -> t -> unit = "ocaml_gstreamer_element_unlink"
+
+  external sync_state_with_parent : t -> unit
+    = "ocaml_gstreamer_element_sync_state_with_parent"
+
   external position : t -> Format.t -> Int64.t
     = "ocaml_gstreamer_element_position"
 
@@ -102,6 +207,16 @@ module Element_factory = struct
   type t = Element.t
 
   external make : string -> string -> t = "ocaml_gstreamer_element_factory_make"
+
+  type factory
+
+  external find : string -> factory = "ocaml_gstreamer_element_factory_find"
+
+  external preload : factory -> unit
+    = "ocaml_gstreamer_element_factory_preload"
+
+  external create : factory -> string -> t
+    = "ocaml_gstreamer_element_factory_create"
 end
 
 module Message = struct
@@ -142,6 +257,41 @@ module Message = struct
 
   type t
 
+  type qos = {
+    live : bool;
+    running_time : Int64.t;
+    stream_time : Int64.t;
+    timestamp : Int64.t;
+    duration : Int64.t;
+    jitter : Int64.t;
+    proportion : float;
+    quality : int;
+    format : Format.t;
+    processed : Int64.t;
+    dropped : Int64.t;
+  }
+
+  type stream_status_type =
+    | Status_create
+    | Status_enter
+    | Status_leave
+    | Status_destroy
+    | Status_start
+    | Status_pause
+    | Status_stop
+
+  type stream_status = { status_type : stream_status_type; owner : string }
+
+  type progress_type =
+    | Progress_start
+    | Progress_continue
+    | Progress_complete
+    | Progress_canceled
+    | Progress_error
+
+  type progress = { progress_type : progress_type; code : string; text : string }
+  type structure = { name : string; fields : (string * string) list }
+
   type msg =
     [ `Unknown
     | `End_of_stream
@@ -157,9 +307,9 @@ module Message = struct
     | `Clock_lost
     | `New_clock
     | `Structure_change
-    | `Stream_status
+    | `Stream_status of stream_status
     | `Application
-    | `Element
+    | `Element of structure
     | `Segment_start
     | `Segment_done
     | `Duration_changed
@@ -168,8 +318,8 @@ module Message = struct
     | `Async_done
     | `Request_state
     | `Step_start
-    | `Qos
-    | `Progress
+    | `Qos of qos
+    | `Progress of progress
     | `Toc
     | `Reset_time
     | `Stream_start
@@ -196,6 +346,21 @@ module Message = struct
   external parse_buffering : t -> int
     = "ocaml_gstreamer_message_parse_buffering"
 
+  external parse_qos : t -> qos = "ocaml_gstreamer_message_parse_qos"
+
+  external parse_stream_status : t -> stream_status
+    = "ocaml_gstreamer_message_parse_stream_status"
+
+  external parse_progress : t -> progress
+    = "ocaml_gstreamer_message_parse_progress"
+
+  external parse_structure : t -> string * (string * string) array
+    = "ocaml_gstreamer_message_parse_structure"
+
+  let parse_structure msg =
+    let name, fields = parse_structure msg in
+    { name; fields = Array.to_list fields }
+
   let message_of_msg msg =
     match message_type msg with
       | Unknown -> `Unknown
@@ -212,9 +377,9 @@ module Message = struct
       | Clock_lost -> `Clock_lost
       | New_clock -> `New_clock
       | Structure_change -> `Structure_change
-      | Stream_status -> `Stream_status
+      | Stream_status -> `Stream_status (parse_stream_status msg)
       | Application -> `Application
-      | Element -> `Element
+      | Element -> `Element (parse_structure msg)
       | Segment_start -> `Segment_start
       | Segment_done -> `Segment_done
       | Duration_changed -> `Duration_changed
@@ -223,8 +388,8 @@ module Message = struct
       | Async_done -> `Async_done
       | Request_state -> `Request_state
       | Step_start -> `Step_start
-      | Qos -> `Qos
-      | Progress -> `Progress
+      | Qos -> `Qos (parse_qos msg)
+      | Progress -> `Progress (parse_progress msg)
       | Toc -> `Toc
       | Reset_time -> `Reset_time
       | Stream_start -> `Stream_start
@@ -242,6 +407,52 @@ module Loop = struct
 end
 
 module Bus = struct
+  type qos = Message.qos = {
+    live : bool;
+    running_time : Int64.t;
+    stream_time : Int64.t;
+    timestamp : Int64.t;
+    duration : Int64.t;
+    jitter : Int64.t;
+    proportion : float;
+    quality : int;
+    format : Format.t;
+    processed : Int64.t;
+    dropped : Int64.t;
+  }
+
+  type stream_status_type = Message.stream_status_type =
+    | Status_create
+    | Status_enter
+    | Status_leave
+    | Status_destroy
+    | Status_start
+    | Status_pause
+    | Status_stop
+
+  type stream_status = Message.stream_status = {
+    status_type : stream_status_type;
+    owner : string;
+  }
+
+  type progress_type = Message.progress_type =
+    | Progress_start
+    | Progress_continue
+    | Progress_complete
+    | Progress_canceled
+    | Progress_error
+
+  type progress = Message.progress = {
+    progress_type : progress_type;
+    code : string;
+    text : string;
+  }
+
+  type structure = Message.structure = {
+    name : string;
+    fields : (string * string) list;
+  }
+
   type message_payload = Message.msg
   type message = { source : string; payload : message_payload }
   type t
@@ -318,9 +529,64 @@ module Bus = struct
     | `Have_context -> Message.Have_context
     | `Any -> Message.Any
 
+  let mesage_type_of_type = function
+    | Message.Unknown -> `Unknown
+    | Message.End_of_stream -> `End_of_stream
+    | Message.Error -> `Error
+    | Message.Warning -> `Warning
+    | Message.Info -> `Info
+    | Message.Tag -> `Tag
+    | Message.Buffering -> `Buffering
+    | Message.State_changed -> `State_changed
+    | Message.State_dirty -> `State_dirty
+    | Message.Step_done -> `Step_done
+    | Message.Clock_provide -> `Clock_provide
+    | Message.Clock_lost -> `Clock_lost
+    | Message.New_clock -> `New_clock
+    | Message.Structure_change -> `Structure_change
+    | Message.Stream_status -> `Stream_status
+    | Message.Application -> `Application
+    | Message.Element -> `Element
+    | Message.Segment_start -> `Segment_start
+    | Message.Segment_done -> `Segment_done
+    | Message.Duration_changed -> `Duration_changed
+    | Message.Latency -> `Latency
+    | Message.Async_start -> `Async_start
+    | Message.Async_done -> `Async_done
+    | Message.Request_state -> `Request_state
+    | Message.Step_start -> `Step_start
+    | Message.Qos -> `Qos
+    | Message.Progress -> `Progress
+    | Message.Toc -> `Toc
+    | Message.Reset_time -> `Reset_time
+    | Message.Stream_start -> `Stream_start
+    | Message.Need_context -> `Need_context
+    | Message.Have_context -> `Have_context
+    | Message.Any -> `Any
+
   let parse_msg msg =
     { source = Message.source_name msg; payload = Message.message_of_msg msg }
 
+  module Handle = struct
+    type t = {
+      msg : Message.t;
+      src : string Lazy.t;
+      contents : message_payload Lazy.t;
+    }
+
+    let of_msg msg =
+      {
+        msg;
+        src = lazy (Message.source_name msg);
+        contents = lazy (Message.message_of_msg msg);
+      }
+
+    let message_type h = mesage_type_of_type (Message.message_type h.msg)
+    let source h = Lazy.force h.src
+    let payload h = Lazy.force h.contents
+    let message h = { source = source h; payload = payload h }
+  end
+
   let any_message = function None -> None | Some msg -> Some (parse_msg msg)
 
   external pop_filtered : t -> Message.message_type array -> Message.t option
@@ -338,6 +604,72 @@ module Bus = struct
     parse_msg
       (timed_pop_filtered bus ?timeout
          (Array.of_list (List.map type_of_mesage_type filter)))
+
+  (* Messages posted while [f] runs are handled as well. *)
+  external drain_with :
+    t -> Message.message_type array -> (Message.t -> unit) -> unit
+    = "ocaml_gstreamer_bus_drain_filtered"
+
+  let drain_filter = function
+    | None -> [| Message.Any |]
+    | Some filter -> Array.of_list (List.map type_of_mesage_type filter)
+
+  let drain ?filter bus f =
+    drain_with bus (drain_filter filter) (fun msg -> f (parse_msg msg))
+
+  external pop_handle : t -> Message.message_type array -> Message.t option
+    = "ocaml_gstreamer_bus_pop_filtered"
+
+  let pop_handle bus filter =
+    match
+      pop_handle bus (Array.of_list (List.map type_of_mesage_type filter))
+    with
+      | None -> None
+      | Some msg -> Some (Handle.of_msg msg)
+
+  external timed_pop_handle :
+    t -> ?timeout:Int64.t -> Message.message_type array -> Message.t
+    = "ocaml_gstreamer_bus_timed_pop_filtered"
+
+  let timed_pop_handle bus ?timeout filter =
+    Handle.of_msg
+      (timed_pop_handle bus ?timeout
+         (Array.of_list (List.map type_of_mesage_type filter)))
+
+  let drain_handles ?filter bus f =
+    drain_with bus (drain_filter filter) (fun msg -> f (Handle.of_msg msg))
+
+  external pollfd : t -> Unix.file_descr = "ocaml_gstreamer_bus_pollfd"
+
+  external add_watch : t -> (Message.t -> bool) -> unit
+    = "ocaml_gstreamer_bus_add_watch"
+
+  let add_watch bus f = add_watch bus (fun msg -> f (parse_msg msg))
+
+  external remove_watch : t -> unit = "ocaml_gstreamer_bus_remove_watch"
+
+  type sync_reply = Sync_drop | Sync_pass | Sync_async
+
+  external set_sync_handler : t -> (Message.t -> sync_reply) option -> unit
+    = "ocaml_gstreamer_bus_set_sync_handler"
+
+  let set_sync_handler bus f =
+    set_sync_handler bus (Some (fun msg -> f (parse_msg msg)))
+
+  let remove_sync_handler bus = set_sync_handler bus None
+
+  type handler = int
+
+  external on_sync_message :
+    t -> Message.message_type -> (Message.t -> unit) -> handler
+    = "ocaml_gstreamer_bus_on_sync_message"
+
+  let on_sync_message bus message_type f =
+    on_sync_message bus
+      (type_of_mesage_type message_type)
+      (fun msg -> f (parse_msg msg))
+
+  external disconnect : t -> handler -> unit = "ocaml_gstreamer_bus_disconnect"
 end
 
 module Bin = struct
@@ -349,6 +681,9 @@ module Bin = struct
 
   let add_many bin e = List.iter (add bin) e
 
+  external remove : t -> Element.t -> unit = "ocaml_gstreamer_bin_remove"
+  external parse : string -> t = "ocaml_gstreamer_bin_parse"
+
   external get_by_name : t -> string -> Element.t
     = "ocaml_gstreamer_bin_get_by_name"
 end
@@ -358,6 +693,68 @@ module Pipeline = struct
 
   external create : string -> t = "ocaml_gstreamer_pipeline_create"
   external parse_launch : string -> t = "ocaml_gstreamer_pipeline_parse_launch"
+
+  external parse_launch_full : string -> t
+    = "ocaml_gstreamer_pipeline_parse_launch_full"
+
+  module Description = struct
+    type t = {
+      description : string;
+      prepared : int;
+      mutex : Mutex.t;
+      pipelines : Element.t Queue.t; (* Pipelines parsed ahead of demand. *)
+    }
+
+    let available d =
+      Mutex.lock d.mutex;
+      let n = Queue.length d.pipelines in
+      Mutex.unlock d.mutex;
+      n
+
+    let rec prepare d =
+      if available d < d.prepared then (
+        let p = parse_launch_full d.description in
+        Mutex.lock d.mutex;
+        (* Another thread might have filled the queue in the meantime. *)
+        if Queue.length d.pipelines < d.prepared then Queue.push p d.pipelines;
+        Mutex.unlock d.mutex;
+        prepare d )
+
+    let create ?(prepared = 1) description =
+      if prepared < 0 then invalid_arg "Pipeline.Description.create";
+      let d =
+        {
+          description;
+          prepared;
+          mutex = Mutex.create ();
+          pipelines = Queue.create ();
+        }
+      in
+      (* Check the description even when nothing is prepared. *)
+      if prepared = 0 then ignore (parse_launch_full description)
+      else prepare d;
+      d
+
+    let take d =
+      Mutex.lock d.mutex;
+      let p =
+        if Queue.is_empty d.pipelines then None
+        else Some (Queue.pop d.pipelines)
+      in
+      Mutex.unlock d.mutex;
+      match p with Some p -> p | None -> parse_launch_full d.description
+
+    let launch ?(properties = []) d =
+      let p = take d in
+      (match properties with
+        | [] -> ()
+        | _ ->
+            Element.set_properties_many
+              (List.map
+                 (fun (name, props) -> (Bin.get_by_name p name, props))
+                 properties));
+      p
+  end
 end
 
 module Buffer = struct
@@ -372,12 +769,49 @@ module Buffer = struct
 
   external of_data : data -> int -> int -> t = "ocaml_gstreamer_buffer_of_data"
 
+  external of_data_wrapped : data -> int -> int -> t
+    = "ocaml_gstreamer_buffer_of_data_wrapped"
+
+  let of_data ?(copy = true) data ofs len =
+    if copy then of_data data ofs len else of_data_wrapped data ofs len
+
   external of_data_list : (data * int * int) list -> t
     = "ocaml_gstreamer_buffer_of_data_list"
 
+  external of_data_list_wrapped : (data * int * int) list -> t
+    = "ocaml_gstreamer_buffer_of_data_list_wrapped"
+
+  let of_data_list ?(copy = true) l =
+    if copy then of_data_list l else of_data_list_wrapped l
+
   external to_data : t -> data = "ocaml_gstreamer_buffer_to_data"
   external to_string : t -> string = "ocaml_gstreamer_buffer_to_string"
 
+  type mapping
+
+  external map : t -> mapping * data = "ocaml_gstreamer_buffer_map"
+  external unmap : mapping -> unit = "ocaml_gstreamer_buffer_unmap"
+
+  external map_memories : t -> (mapping * data) array
+    = "ocaml_gstreamer_buffer_map_memories"
+
+  let mapped_data (m, data) =
+    Gc.finalise (fun _ -> unmap m) data;
+    data
+
+  let map_data buf = mapped_data (map buf)
+  let memories buf = Array.map mapped_data (map_memories buf)
+
+  let with_mapped buf fn =
+    let m, data = map buf in
+    match fn data with
+      | ans ->
+          unmap m;
+          ans
+      | exception exn ->
+          unmap m;
+          raise exn
+
   external set_presentation_time : t -> Int64.t -> unit
     = "ocaml_gstreamer_buffer_set_presentation_time"
 
@@ -386,6 +820,279 @@ module Buffer = struct
 
   external set_duration : t -> Int64.t -> unit
     = "ocaml_gstreamer_buffer_set_duration"
+
+  external presentation_time : t -> Int64.t
+    = "ocaml_gstreamer_buffer_get_presentation_time"
+
+  external decoding_time : t -> Int64.t
+    = "ocaml_gstreamer_buffer_get_decoding_time"
+
+  external duration : t -> Int64.t = "ocaml_gstreamer_buffer_get_duration"
+  external offset : t -> Int64.t = "ocaml_gstreamer_buffer_get_offset"
+
+  external offset_end : t -> Int64.t
+    = "ocaml_gstreamer_buffer_get_offset_end"
+
+  type flag =
+    | Live
+    | Discont
+    | Resync
+    | Corrupted
+    | Marker
+    | Header
+    | Gap
+    | Droppable
+    | Delta_unit
+    | Tag_memory
+    | Sync_after
+    | Non_droppable
+
+  external flags : t -> flag list = "ocaml_gstreamer_buffer_get_flags"
+end
+
+module Sample = struct
+  type t
+
+  type segment = {
+    format : Format.t;
+    rate : float;
+    applied_rate : float;
+    base : Int64.t;
+    offset : Int64.t;
+    start : Int64.t;
+    stop : Int64.t;
+    time : Int64.t;
+    position : Int64.t;
+    duration : Int64.t;
+  }
+
+  external buffer : t -> Buffer.t = "ocaml_gstreamer_sample_buffer"
+  external caps : t -> Caps.t = "ocaml_gstreamer_sample_caps"
+  external segment : t -> segment = "ocaml_gstreamer_sample_segment"
+end
+
+module Pad = struct
+  type t
+
+  external of_element : Element.t -> string -> t
+    = "ocaml_gstreamer_pad_of_element"
+
+  external name : t -> string = "ocaml_gstreamer_pad_name"
+  external current_caps : t -> Caps.t = "ocaml_gstreamer_pad_current_caps"
+  external peer : t -> t = "ocaml_gstreamer_pad_peer"
+  external is_linked : t -> bool = "ocaml_gstreamer_pad_is_linked"
+  external link : t -> t -> unit = "ocaml_gstreamer_pad_link"
+  external unlink : t -> t -> unit = "ocaml_gstreamer_pad_unlink"
+  external request : Element.t -> string -> t = "ocaml_gstreamer_pad_request"
+
+  external release : Element.t -> t -> unit
+    = "ocaml_gstreamer_pad_release"
+
+  type handler = int
+
+  external on_added : Element.t -> (t -> unit) -> handler
+    = "ocaml_gstreamer_pad_on_added"
+
+  external on_no_more_pads : Element.t -> (unit -> unit) -> handler
+    = "ocaml_gstreamer_pad_on_no_more_pads"
+
+  external disconnect : Element.t -> handler -> unit
+    = "ocaml_gstreamer_pad_disconnect"
+
+  external of_property : Element.t -> string -> t
+    = "ocaml_gstreamer_pad_of_property"
+
+  type probe_type =
+    | Probe_idle
+    | Probe_block
+    | Probe_buffer
+    | Probe_buffer_list
+    | Probe_event_downstream
+    | Probe_event_upstream
+    | Probe_event_flush
+    | Probe_query_downstream
+    | Probe_query_upstream
+    | Probe_push
+    | Probe_pull
+
+  type probe_action = Action_pass | Action_drop | Action_collect of int
+
+  type probe_return =
+    | Probe_ok
+    | Probe_drop
+    | Probe_remove
+    | Probe_pass
+
+  type probe
+  type probe_stats = { buffers : int; bytes : int; events : int; queries : int }
+
+  external add_probe : t -> probe_type array -> probe_action -> probe
+    = "ocaml_gstreamer_pad_add_probe"
+
+  let add_probe pad types action = add_probe pad (Array.of_list types) action
+
+  external add_probe_callback :
+    t -> probe_type array -> (Buffer.t option -> probe_return) -> probe
+    = "ocaml_gstreamer_pad_add_probe_callback"
+
+  let add_probe_callback pad types f =
+    add_probe_callback pad (Array.of_list types) f
+
+  external remove_probe : t -> probe -> unit
+    = "ocaml_gstreamer_pad_remove_probe"
+
+  external probe_stats : probe -> probe_stats
+    = "ocaml_gstreamer_pad_probe_stats"
+
+  external probe_collect : probe -> Buffer.t array
+    = "ocaml_gstreamer_pad_probe_collect"
+end
+
+module Playlist = struct
+  type item = {
+    name : string;
+    decoder : Element.t;
+    pad : Pad.t; (* Request pad of concat. *)
+    mutable handlers : Pad.handler list;
+    mutable linked : bool;
+    mutable released : bool; (* Whether the concat pad has been released. *)
+  }
+
+  type t = {
+    pipeline : Pipeline.t;
+    concat : Element.t;
+    mutex : Mutex.t;
+    mutable items : item list; (* Items in playing order. *)
+    mutable count : int;
+  }
+
+  let pipeline p = p.pipeline
+
+  let is_audio pad =
+    try
+      let name = Caps.name (Pad.current_caps pad) in
+      String.length name >= 6 && String.sub name 0 6 = "audio/"
+    with Not_found -> false
+
+  (* Returns [true] if the caller should release the concat pad of the item. *)
+  let take_pad p item =
+    Mutex.lock p.mutex;
+    let release = not item.released in
+    item.released <- true;
+    Mutex.unlock p.mutex;
+    release
+
+  (* Release the concat pad of an item which cannot be played, so that concat
+     moves to the next one. The decoder is removed by [cleanup], since it
+     cannot be stopped from its own threads. *)
+  let skip p item = if take_pad p item then Pad.release p.concat item.pad
+
+  let remove_item p item =
+    let release = take_pad p item in
+    List.iter (Pad.disconnect item.decoder) item.handlers;
+    ignore (Element.set_state item.decoder Element.State_null);
+    Bin.remove p.pipeline item.decoder;
+    if release then Pad.release p.concat item.pad
+
+  (* Item whose decoder contains the element with given name. *)
+  let owner p source =
+    Mutex.lock p.mutex;
+    let items = p.items in
+    Mutex.unlock p.mutex;
+    let contains item =
+      item.name = source
+      ||
+      try
+        ignore (Bin.get_by_name item.decoder source);
+        true
+      with Not_found -> false
+    in
+    match List.filter contains items with [] -> None | item :: _ -> Some item
+
+  let on_error p msg =
+    match owner p msg.Bus.source with Some item -> skip p item | None -> ()
+
+  let create ?sink () =
+    let pipeline = Pipeline.create "playlist" in
+    let concat = Element_factory.make "concat" "concat" in
+    let sink =
+      match sink with
+        | Some sink -> sink
+        | None -> Element_factory.make "autoaudiosink" "sink"
+    in
+    Bin.add_many pipeline [concat; sink];
+    Element.link concat sink;
+    let p =
+      { pipeline; concat; mutex = Mutex.create (); items = []; count = 0 }
+    in
+    ignore (Bus.on_sync_message (Bus.of_element pipeline) `Error (on_error p));
+    p
+
+  let cleanup p =
+    Mutex.lock p.mutex;
+    let skipped, items = List.partition (fun item -> item.released) p.items in
+    p.items <- items;
+    let finished =
+      match Pad.name (Pad.of_property p.concat "active-pad") with
+        | active
+          when List.exists (fun item -> Pad.name item.pad = active) p.items ->
+            let rec split = function
+              | item :: items when Pad.name item.pad <> active ->
+                  let finished, items = split items in
+                  (item :: finished, items)
+              | items -> ([], items)
+            in
+            let finished, items = split p.items in
+            p.items <- items;
+            finished
+        | _ -> []
+        | exception Not_found -> []
+    in
+    Mutex.unlock p.mutex;
+    List.iter (remove_item p) (skipped @ finished)
+
+  let enqueue p uri =
+    cleanup p;
+    Mutex.lock p.mutex;
+    let name = Printf.sprintf "decoder%d" p.count in
+    p.count <- p.count + 1;
+    Mutex.unlock p.mutex;
+    let decoder = Element_factory.make "uridecodebin" name in
+    Element.set_property decoder "uri" (Element.String uri);
+    let pad = Pad.request p.concat "sink_%u" in
+    let item =
+      { name; decoder; pad; handlers = []; linked = false; released = false }
+    in
+    let on_added =
+      Pad.on_added decoder (fun src ->
+          Mutex.lock p.mutex;
+          let link =
+            (not item.linked) && (not item.released) && is_audio src
+          in
+          if link then item.linked <- true;
+          Mutex.unlock p.mutex;
+          if link then Pad.link src pad)
+    in
+    (* No audio pad will ever be linked. *)
+    let on_no_more_pads =
+      Pad.on_no_more_pads decoder (fun () ->
+          Mutex.lock p.mutex;
+          let linked = item.linked in
+          Mutex.unlock p.mutex;
+          if not linked then skip p item)
+    in
+    item.handlers <- [on_added; on_no_more_pads];
+    Mutex.lock p.mutex;
+    p.items <- p.items @ [item];
+    Mutex.unlock p.mutex;
+    Bin.add p.pipeline decoder;
+    Element.sync_state_with_parent decoder
+
+  let length p =
+    Mutex.lock p.mutex;
+    let n = List.length p.items in
+    Mutex.unlock p.mutex;
+    n
 end
 
 module App_src = struct
@@ -397,21 +1104,31 @@ module App_src = struct
   external push_buffer : t -> Buffer.t -> unit
     = "ocaml_gstreamer_appsrc_push_buffer"
 
+  external push_buffer_list : t -> Buffer.t array -> unit
+    = "ocaml_gstreamer_appsrc_push_buffer_list"
+
+  type pool
+
+  external create_pool : int -> int -> int -> pool
+    = "ocaml_gstreamer_appsrc_create_pool"
+
+  let create_pool ~size ~min ~max = create_pool size min max
+
   external push_buffer_bytes :
-    t -> Int64.t -> Int64.t -> bytes -> int -> int -> unit
+    t -> Int64.t -> Int64.t -> pool option -> bytes -> int -> int -> unit
     = "ocaml_gstreamer_appsrc_push_buffer_bytes_b" "ocaml_gstreamer_appsrc_push_buffer_bytes_n"
 
   let push_buffer_bytes src ?(presentation_time = Int64.minus_one)
-      ?(duration = Int64.minus_one) data ofs len =
-    push_buffer_bytes src presentation_time duration data ofs len
+      ?(duration = Int64.minus_one) ?pool data ofs len =
+    push_buffer_bytes src presentation_time duration pool data ofs len
 
   external push_buffer_data :
-    t -> Int64.t -> Int64.t -> data -> int -> int -> unit
+    t -> Int64.t -> Int64.t -> bool -> pool option -> data -> int -> int -> unit
     = "ocaml_gstreamer_appsrc_push_buffer_data_b" "ocaml_gstreamer_appsrc_push_buffer_data_n"
 
   let push_buffer_data src ?(presentation_time = Int64.minus_one)
-      ?(duration = Int64.minus_one) data ofs len =
-    push_buffer_data src presentation_time duration data ofs len
+      ?(duration = Int64.minus_one) ?(copy = true) ?pool data ofs len =
+    push_buffer_data src presentation_time duration copy pool data ofs len
 
   external on_need_data : t -> (int -> unit) -> unit
     = "ocaml_gstreamer_appsrc_connect_need_data"
@@ -420,6 +1137,8 @@ module App_src = struct
 
   external set_format : t -> Format.t -> unit
     = "ocaml_gstreamer_appsrc_set_format"
+
+  external set_caps : t -> Caps.t -> unit = "ocaml_gstreamer_appsrc_set_caps"
 end
 
 module App_sink = struct
@@ -427,6 +1146,19 @@ module App_sink = struct
 
   external of_element : Element.t -> t = "ocaml_gstreamer_appsink_of_element"
   external pull_buffer : t -> Buffer.t = "ocaml_gstreamer_appsink_pull_buffer"
+  external pull_sample : t -> Sample.t = "ocaml_gstreamer_appsink_pull_sample"
+
+  external try_pull_sample : t -> timeout:Int64.t -> Sample.t option
+    = "ocaml_gstreamer_appsink_try_pull_sample"
+
+  external pull_many : t -> ?timeout:Int64.t -> int -> Buffer.t array
+    = "ocaml_gstreamer_appsink_pull_many"
+
+  external try_pull_buffer : t -> timeout:Int64.t -> Buffer.t option
+    = "ocaml_gstreamer_appsink_try_pull_buffer"
+
+  external try_pull_preroll : t -> timeout:Int64.t -> Buffer.t option
+    = "ocaml_gstreamer_appsink_try_pull_preroll"
 
   let pull_buffer_data sink = Buffer.to_data (pull_buffer sink)
   let pull_buffer_string sink = Buffer.to_string (pull_buffer sink)
@@ -437,14 +1169,77 @@ module App_sink = struct
   external on_new_sample : t -> (unit -> unit) -> unit
     = "ocaml_gstreamer_appsink_connect_new_sample"
 
+  external set_callbacks :
+    t ->
+    bool ->
+    (unit -> unit) option ->
+    ('a -> unit) option ->
+    ('a -> unit) option ->
+    unit = "ocaml_gstreamer_appsink_set_callbacks"
+
+  let set_callbacks sink ?eos ?new_preroll ?new_sample () =
+    set_callbacks sink false eos new_preroll new_sample
+
+  let set_buffer_callbacks sink ?eos ?new_preroll ?new_sample () =
+    set_callbacks sink true eos new_preroll new_sample
+
+  external enable_ring : t -> int -> unit
+    = "ocaml_gstreamer_appsink_enable_ring"
+
+  external drain_ring : t -> int -> Buffer.t array
+    = "ocaml_gstreamer_appsink_drain_ring"
+
   external set_max_buffers : t -> int -> unit
     = "ocaml_gstreamer_appsink_set_max_buffers"
+
+  external set_caps : t -> Caps.t -> unit = "ocaml_gstreamer_appsink_set_caps"
+  external get_caps : t -> Caps.t = "ocaml_gstreamer_appsink_get_caps"
 end
 
-module Caps = struct
+module App_bridge = struct
   type t
+  type stats = { buffers : int; bytes : int; inspected : int }
 
-  external to_string : t -> string = "ocaml_gstreamer_caps_to_string"
+  external connect :
+    App_sink.t -> App_src.t -> (Buffer.t -> unit) option -> int -> t
+    = "ocaml_gstreamer_app_bridge_connect"
+
+  let connect ?inspect ?(inspect_every = 1) sink src =
+    connect sink src inspect inspect_every
+
+  external disconnect : t -> unit = "ocaml_gstreamer_app_bridge_disconnect"
+  external stats : t -> stats = "ocaml_gstreamer_app_bridge_stats"
+end
+
+module Dsp = struct
+  type samples =
+    (float, Bigarray.float32_elt, Bigarray.c_layout) Bigarray.Array1.t
+
+  external of_s16le : data -> int -> samples -> int -> int -> unit
+    = "ocaml_gstreamer_dsp_of_s16le"
+
+  external to_s16le : samples -> int -> data -> int -> int -> unit
+    = "ocaml_gstreamer_dsp_to_s16le"
+
+  external gain : samples -> int -> int -> float -> unit
+    = "ocaml_gstreamer_dsp_gain"
+
+  external mix : float array -> samples array -> samples -> int -> unit
+    = "ocaml_gstreamer_dsp_mix"
+
+  let mix ?gains srcs dst len =
+    let gains =
+      match gains with
+        | Some gains -> gains
+        | None -> Array.make (Array.length srcs) 1.
+    in
+    mix gains srcs dst len
+
+  external interleave : samples array -> samples -> int -> unit
+    = "ocaml_gstreamer_dsp_interleave"
+
+  external deinterleave : samples -> samples array -> int -> unit
+    = "ocaml_gstreamer_dsp_deinterleave"
 end
 
 module Type_find_element = struct
@@ -9,8 +9,26 @@ exception Failed
 exception End_of_stream
 
 (** Initialize GStreamer. This function should be called before anything
-    other GStreamer function. *)
-val init : ?argv:string array -> unit -> unit
+    other GStreamer function. The registry of plugins can be controlled with
+    the following options:
+    - [registry_fork]: whether a helper process should be forked in order to
+      scan plugins,
+    - [registry_update]: whether the registry should be updated when plugins
+      have changed (it is loaded from its cache file otherwise),
+    - [registry]: location of the registry cache file,
+    - [plugin_path]: directories in which plugins are looked for, in place of
+      the system ones.
+
+    Apart from [registry_fork], these are set through environment variables,
+    and are thus inherited by child processes. *)
+val init :
+  ?argv:string array ->
+  ?registry_fork:bool ->
+  ?registry_update:bool ->
+  ?registry:string ->
+  ?plugin_path:string list ->
+  unit ->
+  unit
 
 (** Uninitialize GStreamer. This function does not normally need to be called
     excepting when debugging memory. *)
@@ -56,6 +74,56 @@ module Event : sig
     | Seek_flag_snap_nearest
 end
 
+(** Capabilities. *)
+module Caps : sig
+  type t
+
+  val to_string : t -> string
+
+  (** Parse caps from their string representation. Raises [Failed] if the
+      string is invalid. *)
+  val of_string : string -> t
+
+  (** Value of a field of caps. *)
+  type field_value =
+    | Int of int
+    | Double of float
+    | Bool of bool
+    | String of string
+    | Fraction of int * int
+
+  (** [make name fields] creates caps consisting of one structure with given
+      name and fields. *)
+  val make : string -> (string * field_value) list -> t
+
+  (** Caps for interleaved raw audio, e.g. [audio_raw ~format:"S16LE"
+      ~rate:44100 ~channels:2]. *)
+  val audio_raw : format:string -> rate:int -> channels:int -> t
+
+  (** Caps for raw video, e.g. [video_raw ~format:"I420" ~width:1280
+      ~height:720 ~framerate:(25, 1)]. *)
+  val video_raw :
+    format:string -> width:int -> height:int -> framerate:int * int -> t
+
+  (** Number of structures in caps. *)
+  val size : t -> int
+
+  (** Name of a structure (the first one by default). *)
+  val name : ?index:int -> t -> string
+
+  (** Value of a field of a structure (the first one by default). Raises
+      [Not_found] if there is no such field and [Failed] if it is not fixed. *)
+  val get_field : ?index:int -> t -> string -> field_value
+
+  (** Whether caps are fixed, i.e. describe exactly one format. *)
+  val is_fixed : t -> bool
+
+  val is_empty : t -> bool
+
+  (** Formats described by both caps. *)
+  val intersect : t -> t -> t
+end
+
 (** Elements. *)
 module Element : sig
   (** An element. *)
@@ -65,6 +133,36 @@ module Element : sig
   val set_property_int : t -> string -> string -> unit
   val set_property_bool : t -> string -> string -> unit
 
+  (** Value of a property. *)
+  type property_value =
+    | Int of int  (** Any integer property, converted to its actual type. *)
+    | Int64 of Int64.t
+    | Uint64 of Int64.t  (** Unsigned, stored in a signed integer. *)
+    | Double of float  (** Any floating point property. *)
+    | Bool of bool
+    | String of string
+        (** String property, or any property given in its string
+            representation. *)
+    | Enum of int  (** Enumeration or flags. *)
+    | Caps of Caps.t
+
+  (** Set a property of an element. Raises [Not_found] if the element has no
+      such property and [Failed] if the value cannot be converted to the type
+      of the property. *)
+  val set_property : t -> string -> property_value -> unit
+
+  (** Get a property of an element. Integers which do not fit in [int] are
+      returned as [Int64] or [Uint64]. Raises [Not_found] if the element has
+      no such property and [Failed] if its type is not supported. *)
+  val get_property : t -> string -> property_value
+
+  (** Set multiple properties of an element at once. Nothing is set if one of
+      the properties does not exist or cannot be converted. *)
+  val set_properties : t -> (string * property_value) list -> unit
+
+  (** Same as [set_properties] for multiple elements. *)
+  val set_properties_many : (t * (string * property_value) list) list -> unit
+
   (** State of an element. *)
   type state =
     | State_void_pending
@@ -93,6 +191,13 @@ module Element : sig
   (** Sequentially link a list of element. *)
   val link_many : t list -> unit
 
+  (** Unlink two elements. *)
+  val unlink : t -> t -> unit
+
+  (** Set the state of an element to the one of its parent, typically after
+      adding it to a running pipeline. *)
+  val sync_state_with_parent : t -> unit
+
   (** Current position of an element. *)
   val position : t -> Format.t -> Int64.t
 
@@ -108,6 +213,21 @@ module Element_factory : sig
   type t = Element.t
 
   val make : string -> string -> t
+
+  (** An element factory. *)
+  type factory
+
+  (** Find a factory by name in the registry. Raises [Not_found] if there is
+      no such factory. *)
+  val find : string -> factory
+
+  (** Load the plugin providing the factory, so that creating the first
+      element does not have to. Raises [Failed] if the plugin cannot be
+      loaded. *)
+  val preload : factory -> unit
+
+  (** [create factory name] creates an element with given name. *)
+  val create : factory -> string -> t
 end
 
 (** Main loop. *)
@@ -158,6 +278,47 @@ module Bus : sig
     | `Have_context
     | `Any ]
 
+  (** Quality of service statistics. Times are in nanoseconds and [processed]
+      and [dropped] are counted in [format] units. *)
+  type qos = {
+    live : bool;
+    running_time : Int64.t;
+    stream_time : Int64.t;
+    timestamp : Int64.t;
+    duration : Int64.t;
+    jitter : Int64.t;  (** Difference with the desired running time. *)
+    proportion : float;  (** Long-term proportion of processing rate. *)
+    quality : int;  (** Quality level, between 0 and 1000000. *)
+    format : Format.t;
+    processed : Int64.t;
+    dropped : Int64.t;
+  }
+
+  type stream_status_type =
+    | Status_create
+    | Status_enter
+    | Status_leave
+    | Status_destroy
+    | Status_start
+    | Status_pause
+    | Status_stop
+
+  (** Status of a streaming thread, with the name of the element owning it. *)
+  type stream_status = { status_type : stream_status_type; owner : string }
+
+  type progress_type =
+    | Progress_start
+    | Progress_continue
+    | Progress_complete
+    | Progress_canceled
+    | Progress_error
+
+  type progress = { progress_type : progress_type; code : string; text : string }
+
+  (** Element-specific message: name of the structure and its fields, whose
+      values are converted to strings. *)
+  type structure = { name : string; fields : (string * string) list }
+
   type message_payload =
     [ `Unknown
     | `End_of_stream
@@ -173,9 +334,9 @@ module Bus : sig
     | `Clock_lost
     | `New_clock
     | `Structure_change
-    | `Stream_status
+    | `Stream_status of stream_status
     | `Application
-    | `Element
+    | `Element of structure
     | `Segment_start
     | `Segment_done
     | `Duration_changed
@@ -184,8 +345,8 @@ module Bus : sig
     | `Async_done
     | `Request_state
     | `Step_start
-    | `Qos
-    | `Progress
+    | `Qos of qos
+    | `Progress of progress
     | `Toc
     | `Reset_time
     | `Stream_start
@@ -197,6 +358,87 @@ module Bus : sig
   val of_element : Element.t -> t
   val pop_filtered : t -> message_type list -> message option
   val timed_pop_filtered : t -> ?timeout:Int64.t -> message_type list -> message
+
+  (** Call a function on every pending message of the bus, without waiting.
+      When a [filter] is given, other messages are discarded without
+      allocating anything. Matching messages are passed to the function one at
+      a time, so only a handle and its decoded contents are allocated for
+      each. *)
+  val drain : ?filter:message_type list -> t -> (message -> unit) -> unit
+
+  (** A file descriptor which becomes readable when messages are pending on the
+      bus. This can be used to integrate the bus with other event loops, in
+      which case messages should be retrieved with [drain] when the descriptor
+      is readable. Raises [Failed] on Windows, where this is not available. *)
+  val pollfd : t -> Unix.file_descr
+
+  (** Messages whose source and payload are only decoded when they are
+      accessed, which is cheaper when only the type of messages matters. *)
+  module Handle : sig
+    type t
+
+    val message_type : t -> message_type
+    val source : t -> string
+
+    (** Payload of the message, decoded on first access. *)
+    val payload : t -> message_payload
+
+    val message : t -> message
+  end
+
+  (** Same as [pop_filtered] but returns a message handle. *)
+  val pop_handle : t -> message_type list -> Handle.t option
+
+  (** Same as [timed_pop_filtered] but returns a message handle. *)
+  val timed_pop_handle :
+    t -> ?timeout:Int64.t -> message_type list -> Handle.t
+
+  (** Same as [drain] but with message handles. *)
+  val drain_handles :
+    ?filter:message_type list -> t -> (Handle.t -> unit) -> unit
+
+  (** Add a watch on the bus: the function is called on every message from the
+      thread running the main loop (see [Loop.run]) and the watch is removed
+      when it returns [false]. If the function raises an exception, it is
+      reported as a GLib warning and the watch is removed as well. There can be
+      only one watch per bus. *)
+  val add_watch : t -> (message -> bool) -> unit
+
+  (** Remove the watch of the bus. *)
+  val remove_watch : t -> unit
+
+  (** What should be done with a message after the sync handler is called. *)
+  type sync_reply =
+    | Sync_drop  (** Drop the message. *)
+    | Sync_pass  (** Pass the message to the bus queue. *)
+    | Sync_async
+        (** Pass the message to the bus queue and wait for it to be handled. *)
+
+  (** Set the sync handler of the bus: the function is called on every message
+      from the thread posting it, before it is queued. This replaces any
+      previous sync handler. The function runs on GStreamer streaming threads
+      while the bus is locked, so it must not call functions of this module on
+      the same bus, which can deadlock. Exceptions raised by the function are
+      reported as GLib warnings and the message is passed. *)
+  val set_sync_handler : t -> (message -> sync_reply) -> unit
+
+  (** Remove the sync handler of the bus. *)
+  val remove_sync_handler : t -> unit
+
+  (** A handler registered with [on_sync_message]. *)
+  type handler
+
+  (** [on_sync_message bus t f] calls [f] on every message of type [t] (or
+      every message for [`Any]) from the thread posting it, after the sync
+      handler unless it drops the message. Other messages are not decoded. Unlike the sync handler, any
+      number of functions can be registered, but they cannot drop messages.
+      The same restrictions as for [set_sync_handler] apply, and exceptions
+      raised by [f] are reported as GLib warnings. *)
+  val on_sync_message : t -> message_type -> (message -> unit) -> handler
+
+  (** Remove a handler registered with [on_sync_message]. This does nothing if
+      it was already removed. *)
+  val disconnect : t -> handler -> unit
 end
 
 (** Bins. *)
@@ -207,6 +449,14 @@ module Bin : sig
   val add : t -> Element.t -> unit
   val add_many : t -> Element.t list -> unit
 
+  (** Remove an element from a bin. Its state should be set to [State_null]
+      afterwards. *)
+  val remove : t -> Element.t -> unit
+
+  (** Create a bin from a string description, such as ["audioconvert !
+      autoaudiosink"]. Unlinked pads are exposed by the bin. *)
+  val parse : string -> t
+
   (** [get_by_name "foo"] find a bin by name. Raises [Not_found] if element does
       not exist. *)
   val get_by_name : t -> string -> Element.t
@@ -220,6 +470,31 @@ module Pipeline : sig
 
   (** Create a pipeline from a string description. *)
   val parse_launch : string -> t
+
+  (** Descriptions from which pipelines are parsed ahead of demand, so that
+      launching a pipeline does not wait for parsing and element creation. *)
+  module Description : sig
+    type t
+
+    (** [create ?prepared description] parses [prepared] (default: [1])
+        pipelines from [description] in advance. Raises [Error] if the
+        description is invalid, or if one of its elements cannot be created,
+        and [Invalid_argument] if [prepared] is negative. *)
+    val create : ?prepared:int -> string -> t
+
+    (** Parse pipelines until [prepared] of them are available. This is
+        typically called after [launch], from a thread which is not on the
+        critical path. *)
+    val prepare : t -> unit
+
+    (** Return a pipeline parsed in advance, or parse a new one if there is
+        none left. [properties] are set on the elements with the given names
+        before the pipeline is returned. *)
+    val launch :
+      ?properties:(string * (string * Element.property_value) list) list ->
+      t ->
+      Element.t
+  end
 end
 
 (** Buffers. *)
@@ -230,13 +505,41 @@ module Buffer : sig
   (** Create a buffer containing a given string as contents. *)
   val of_string : string -> int -> int -> t
 
-  (** Create a buffer containing given data as contents. *)
-  val of_data : data -> int -> int -> t
+  (** Create a buffer containing given data as contents. When [copy] is
+      [false] (default is [true]), the buffer directly uses the memory of the
+      data, which is kept alive until GStreamer releases the buffer, and should
+      thus not be modified afterwards. *)
+  val of_data : ?copy:bool -> data -> int -> int -> t
 
-  val of_data_list : (data * int * int) list -> t
+  (** Create a buffer containing the concatenation of given data. When [copy]
+      is [false] (default is [true]), each data is used as a separate memory
+      of the buffer without being copied (see [of_data]). Note that GStreamer
+      merges memories when there are more than 16 of them. *)
+  val of_data_list : ?copy:bool -> (data * int * int) list -> t
+
+  (** Copy the contents of a buffer. *)
   val to_data : t -> data
+
   val to_string : t -> string
 
+  (** Contents of a buffer, without copying. The returned data points directly
+      to the memory of the buffer, which is mapped read-only and might be
+      shared with other buffers: it must not be written to. The memory is kept
+      mapped until the returned data is garbage collected, but not by
+      sub-arrays taken with [Bigarray.Array1.sub], which must not outlive
+      it. *)
+  val map_data : t -> data
+
+  (** [with_mapped buf f] calls [f] on the contents of [buf] without copying
+      them. The buffer is unmapped when [f] returns, so the data should not be
+      used afterwards. This should be preferred over [map_data] in loops since
+      memory is released immediately. *)
+  val with_mapped : t -> (data -> 'a) -> 'a
+
+  (** Contents of each of the memories of a buffer, without copying nor merging
+      them (see [map_data]). *)
+  val memories : t -> data array
+
   (** Set the presentation time of a buffer. *)
   val set_presentation_time : t -> Int64.t -> unit
 
@@ -245,6 +548,207 @@ module Buffer : sig
 
   (** Set the duration of a buffer. *)
   val set_duration : t -> Int64.t -> unit
+
+  (** Presentation time of a buffer ([-1] if not defined). *)
+  val presentation_time : t -> Int64.t
+
+  (** Decoding time of a buffer ([-1] if not defined). *)
+  val decoding_time : t -> Int64.t
+
+  (** Duration of a buffer ([-1] if not defined). *)
+  val duration : t -> Int64.t
+
+  (** Media-specific offset of a buffer ([-1] if not defined). *)
+  val offset : t -> Int64.t
+
+  (** Media-specific offset of the end of a buffer ([-1] if not defined). *)
+  val offset_end : t -> Int64.t
+
+  (** Flags of buffers. *)
+  type flag =
+    | Live
+    | Discont
+    | Resync
+    | Corrupted
+    | Marker
+    | Header
+    | Gap
+    | Droppable
+    | Delta_unit
+    | Tag_memory
+    | Sync_after
+    | Non_droppable
+
+  (** Flags set on a buffer. *)
+  val flags : t -> flag list
+end
+
+(** Samples: buffers along with their caps and segment. *)
+module Sample : sig
+  type t
+
+  (** A segment, which describes how buffer times relate to the stream. *)
+  type segment = {
+    format : Format.t;
+    rate : float;
+    applied_rate : float;
+    base : Int64.t;
+    offset : Int64.t;
+    start : Int64.t;
+    stop : Int64.t;
+    time : Int64.t;
+    position : Int64.t;
+    duration : Int64.t;
+  }
+
+  (** Buffer of a sample. Raises [Not_found] if there is none. *)
+  val buffer : t -> Buffer.t
+
+  (** Caps of a sample. Raises [Not_found] if there are none. *)
+  val caps : t -> Caps.t
+
+  (** Segment of a sample. Raises [Not_found] if there is none. *)
+  val segment : t -> segment
+end
+
+(** Pads. *)
+module Pad : sig
+  (** A pad. *)
+  type t
+
+  (** [of_element e name] returns the static pad named [name] of element [e].
+      Raises [Not_found] if there is no such pad. *)
+  val of_element : Element.t -> string -> t
+
+  (** Name of a pad. *)
+  val name : t -> string
+
+  (** Currently negotiated caps of a pad. Raises [Not_found] if there are
+      none. *)
+  val current_caps : t -> Caps.t
+
+  (** Pad a pad is linked to. Raises [Not_found] if it is not linked. *)
+  val peer : t -> t
+
+  val is_linked : t -> bool
+
+  (** [link src sink] links a source pad to a sink pad. *)
+  val link : t -> t -> unit
+
+  (** [unlink src sink] unlinks two pads. *)
+  val unlink : t -> t -> unit
+
+  (** [request e template] requests a new pad of element [e] from a pad
+      template name such as ["sink_%u"]. Raises [Not_found] if the pad cannot
+      be created. *)
+  val request : Element.t -> string -> t
+
+  (** Release a pad obtained with [request]. *)
+  val release : Element.t -> t -> unit
+
+  (** A signal handler connected to an element. *)
+  type handler
+
+  (** Call a function on every pad dynamically added to an element (e.g. by a
+      demuxer or [decodebin]). The function is called from GStreamer
+      threads, and exceptions it raises are reported as GLib warnings. *)
+  val on_added : Element.t -> (t -> unit) -> handler
+
+  (** Call a function when an element will not add any more pads. As for
+      [on_added], exceptions are reported as GLib warnings. *)
+  val on_no_more_pads : Element.t -> (unit -> unit) -> handler
+
+  (** Disconnect a handler from the element it was connected to. This does
+      nothing if it was already disconnected. *)
+  val disconnect : Element.t -> handler -> unit
+
+  (** Pad stored in a property of an element, such as the ["active-pad"] of
+      selectors. Raises [Not_found] if the property is empty. *)
+  val of_property : Element.t -> string -> t
+
+  (** Types of probes. *)
+  type probe_type =
+    | Probe_idle
+    | Probe_block
+    | Probe_buffer
+    | Probe_buffer_list
+    | Probe_event_downstream
+    | Probe_event_upstream
+    | Probe_event_flush
+    | Probe_query_downstream
+    | Probe_query_upstream
+    | Probe_push
+    | Probe_pull
+
+  (** Actions performed natively by probes, without calling OCaml code. *)
+  type probe_action =
+    | Action_pass  (** Let data pass. *)
+    | Action_drop  (** Drop buffers. *)
+    | Action_collect of int
+        (** Let data pass and keep a reference to at most given number of
+            buffers, which can be retrieved with [probe_collect]. *)
+
+  (** Return value of probe callbacks. *)
+  type probe_return =
+    | Probe_ok
+    | Probe_drop
+    | Probe_remove
+    | Probe_pass
+
+  (** A probe. *)
+  type probe
+
+  (** Statistics about the data which went through a probe. *)
+  type probe_stats = { buffers : int; bytes : int; events : int; queries : int }
+
+  (** Add a probe performing a native action on data. *)
+  val add_probe : t -> probe_type list -> probe_action -> probe
+
+  (** Add a probe calling an OCaml function on data, with the buffer when there
+      is one. The function is called from GStreamer threads. When the probe
+      has type [Probe_block], the pad stays blocked while the function returns
+      [Probe_ok], until the probe is removed, which can be used to safely
+      reconfigure a running pipeline. If the function raises an exception, it
+      is reported as a GLib warning and the probe returns [Probe_ok]. *)
+  val add_probe_callback :
+    t -> probe_type list -> (Buffer.t option -> probe_return) -> probe
+
+  (** Remove a probe from a pad. *)
+  val remove_probe : t -> probe -> unit
+
+  (** Statistics of a probe. *)
+  val probe_stats : probe -> probe_stats
+
+  (** Retrieve buffers collected by a probe. *)
+  val probe_collect : probe -> Buffer.t array
+end
+
+(** Gapless playback of a sequence of URIs. Each item is decoded by its own
+    [uridecodebin] feeding a [concat] element, so that the next item is
+    started and prerolled while the current one is playing, and played as
+    soon as the current one ends. Only audio is handled. *)
+module Playlist : sig
+  type t
+
+  (** Create a playlist playing to given sink ([autoaudiosink] by default).
+      Items which cannot be decoded or have no audio are skipped. Errors of
+      skipped items are still posted on the bus of the pipeline, with the name
+      of an element of their decoder as source. *)
+  val create : ?sink:Element.t -> unit -> t
+
+  (** Pipeline of the playlist, whose state is controlled by the caller. It
+      reaches the end of stream after the last item. *)
+  val pipeline : t -> Pipeline.t
+
+  (** Add an item at the end of the playlist. In order to be played without
+      gap, it should be enqueued before the previous one ends. *)
+  val enqueue : t -> string -> unit
+
+  (** Remove items which have been played. This is also done by [enqueue]. *)
+  val cleanup : t -> unit
+
+  (** Number of items which have not been removed. *)
+  val length : t -> int
 end
 
 (** App sources. *)
@@ -257,21 +761,39 @@ module App_src : sig
   (** Push a buffer. *)
   val push_buffer : t -> Buffer.t -> unit
 
-  (** Push a buffer in bytes format. *)
+  (** Push multiple buffers at once. *)
+  val push_buffer_list : t -> Buffer.t array -> unit
+
+  (** A pool of buffers, which are recycled once GStreamer is done with
+      them. *)
+  type pool
+
+  (** Create a pool of buffers of [size] bytes, with at least [min] and at most
+      [max] buffers allocated ([0] means no maximum). When the maximum is
+      reached, pushing waits for a buffer to be released. *)
+  val create_pool : size:int -> min:int -> max:int -> pool
+
+  (** Push a buffer in bytes format. When a [pool] is given, the buffer is taken
+      from it if it is large enough. *)
   val push_buffer_bytes :
     t ->
     ?presentation_time:Int64.t ->
     ?duration:Int64.t ->
+    ?pool:pool ->
     bytes ->
     int ->
     int ->
     unit
 
-  (** Push a buffer in data format. *)
+  (** Push a buffer in data format. When [copy] is [false], the data is not
+      copied (see [Buffer.of_data]), otherwise it is copied to a buffer from
+      [pool] if there is one (see [push_buffer_bytes]). *)
   val push_buffer_data :
     t ->
     ?presentation_time:Int64.t ->
     ?duration:Int64.t ->
+    ?copy:bool ->
+    ?pool:pool ->
     data ->
     int ->
     int ->
@@ -285,6 +807,9 @@ module App_src : sig
   val end_of_stream : t -> unit
 
   val set_format : t -> Format.t -> unit
+
+  (** Set the caps of the produced buffers. *)
+  val set_caps : t -> Caps.t -> unit
 end
 
 (** App sinks. *)
@@ -294,7 +819,33 @@ module App_sink : sig
   val of_element : Element.t -> t
   val pull_buffer : t -> Buffer.t
 
-  (** Pull a buffer in data format. *)
+  (** Pull a sample, which contains a buffer along with its caps and segment. *)
+  val pull_sample : t -> Sample.t
+
+  (** Pull a sample, waiting for at most [timeout] nanoseconds (see
+      [try_pull_buffer]). *)
+  val try_pull_sample : t -> timeout:Int64.t -> Sample.t option
+
+  (** [pull_many sink n] pulls at most [n] buffers at once: it waits for a
+      first buffer, for at most [timeout] nanoseconds if specified, and then
+      takes the buffers which are already available. An empty array is returned
+      if the timeout expired. Raises [End_of_stream] if the end of stream was
+      reached. *)
+  val pull_many : t -> ?timeout:Int64.t -> int -> Buffer.t array
+
+  (** Pull a buffer, waiting for at most [timeout] nanoseconds. [None] is
+      returned if no buffer was available in time. Raises [End_of_stream] if
+      the end of stream was reached. *)
+  val try_pull_buffer : t -> timeout:Int64.t -> Buffer.t option
+
+  (** Pull the preroll buffer, waiting for at most [timeout] nanoseconds.
+      [None] is returned if no buffer was available in time. Raises
+      [End_of_stream] if the end of stream was reached. *)
+  val try_pull_preroll : t -> timeout:Int64.t -> Buffer.t option
+
+  (** Pull a buffer in data format. The data is copied, use [pull_buffer]
+      together with [Buffer.map_data] or [Buffer.with_mapped] in order to
+      avoid the copy. *)
   val pull_buffer_data : t -> data
 
   (** Pull a buffer in string format. *)
@@ -311,15 +862,124 @@ module App_sink : sig
       in order for the callback to be called. *)
   val on_new_sample : t -> (unit -> unit) -> unit
 
+  (** Register callbacks which will be called when the end of stream is
+      reached, when a preroll sample is available and when a sample is
+      available. This is more efficient than [on_new_sample] and does not
+      require [emit_signals]. Callbacks are called from GStreamer threads and
+      replace previously registered ones. If a callback raises an exception, an
+      error message describing it is posted on the bus, and sample callbacks
+      stop the stream. *)
+  val set_callbacks :
+    t ->
+    ?eos:(unit -> unit) ->
+    ?new_preroll:(unit -> unit) ->
+    ?new_sample:(unit -> unit) ->
+    unit ->
+    unit
+
+  (** Same as [set_callbacks] but the buffers are pulled and directly passed to
+      the callbacks. *)
+  val set_buffer_callbacks :
+    t ->
+    ?eos:(unit -> unit) ->
+    ?new_preroll:(Buffer.t -> unit) ->
+    ?new_sample:(Buffer.t -> unit) ->
+    unit ->
+    unit
+
+  (** [enable_ring sink n] makes GStreamer threads store available samples in a
+      native ring of [n] samples (rounded up to a power of two), without ever
+      calling OCaml code. The ring should then be emptied using [drain_ring].
+      When the ring is full, samples are kept in the queue of the sink, whose
+      size can be bounded with [set_max_buffers]. This replaces callbacks
+      registered with [set_callbacks]. Raises [Invalid_argument] if [n] is not
+      positive or too large. *)
+  val enable_ring : t -> int -> unit
+
+  (** [drain_ring sink n] takes at most [n] buffers from the ring, without
+      waiting. Concurrent drains are serialized. Raises [Failed] if the ring
+      was not enabled. *)
+  val drain_ring : t -> int -> Buffer.t array
+
   (** Set the maximal number of internal buffers. *)
   val set_max_buffers : t -> int -> unit
+
+  (** Restrict the caps accepted by the sink. *)
+  val set_caps : t -> Caps.t -> unit
+
+  (** Caps accepted by the sink. Raises [Not_found] if they were not set. *)
+  val get_caps : t -> Caps.t
 end
 
-(** Capabilities. *)
-module Caps : sig
+(** Bridges forwarding buffers from an app sink to an app source (typically in
+    another pipeline) without going through OCaml. *)
+module App_bridge : sig
   type t
 
-  val to_string : t -> string
+  (** Statistics about the forwarded buffers. *)
+  type stats = { buffers : int; bytes : int; inspected : int }
+
+  (** [connect sink src] forwards every sample of [sink] to [src], along with
+      its caps, from the streaming thread of [sink], and ends the stream of
+      [src] when [sink] reaches the end of stream. Buffers are passed by
+      reference, without copying. When [inspect] is given, it is called on
+      one buffer every [inspect_every] (default: [1]), from the streaming
+      thread, before the buffer is forwarded, and the stream stops with an
+      error if it raises an exception. This replaces callbacks and rings of
+      [sink] (see [App_sink.set_callbacks]), and [src] should typically be in
+      [Format.Time] format. The bridge keeps running when [sink] is
+      finalized. Raises [Invalid_argument] if [inspect_every] is not positive
+      or too large. *)
+  val connect :
+    ?inspect:(Buffer.t -> unit) ->
+    ?inspect_every:int ->
+    App_sink.t ->
+    App_src.t ->
+    t
+
+  (** Stop forwarding buffers. *)
+  val disconnect : t -> unit
+
+  (** Statistics of a bridge. *)
+  val stats : t -> stats
+end
+
+(** Native processing of audio samples. All the functions release the OCaml
+    runtime while processing and raise [Invalid_argument] when offsets or
+    lengths are out of bounds. Inputs and outputs should not overlap. Loops
+    rely on the vectorizer of the C compiler, which is enabled when available,
+    instead of explicit SIMD instructions. *)
+module Dsp : sig
+  (** Audio samples, between -1 and 1. *)
+  type samples =
+    (float, Bigarray.float32_elt, Bigarray.c_layout) Bigarray.Array1.t
+
+  (** [of_s16le src ofs dst dofs len] converts [len] S16LE samples read from
+      [src] at byte offset [ofs] to samples written in [dst] at offset
+      [dofs]. *)
+  val of_s16le : data -> int -> samples -> int -> int -> unit
+
+  (** [to_s16le src ofs dst dofs len] converts [len] samples read from [src] at
+      offset [ofs] to S16LE samples written in [dst] at byte offset [dofs].
+      Samples are clipped. *)
+  val to_s16le : samples -> int -> data -> int -> int -> unit
+
+  (** [gain buf ofs len g] multiplies [len] samples of [buf] at offset [ofs] by
+      [g]. *)
+  val gain : samples -> int -> int -> float -> unit
+
+  (** [mix ?gains srcs dst len] writes in [dst] the sum of the first [len]
+      samples of each source, each one multiplied by its gain ([1.] by
+      default). *)
+  val mix : ?gains:float array -> samples array -> samples -> int -> unit
+
+  (** [interleave srcs dst len] interleaves [len] samples of each channel in
+      [srcs] into [dst]. *)
+  val interleave : samples array -> samples -> int -> unit
+
+  (** [deinterleave src dsts len] splits [len] interleaved frames of [src] into
+      one buffer per channel. *)
+  val deinterleave : samples -> samples array -> int -> unit
 end
 
 (** Type finders. *)
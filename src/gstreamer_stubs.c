@@ -5,6 +5,7 @@
 #include <caml/fail.h>
 #include <caml/memory.h>
 #include <caml/mlvalues.h>
+#include <caml/printexc.h>
 #include <caml/threads.h>
 
 #ifndef Bytes_val
@@ -47,6 +48,77 @@ static void ocaml_gstreamer_register_thread() {
   }
 }
 
+/* Report an exception raised by an OCaml function called from a GStreamer
+ * thread, where there is no OCaml code to raise it to. This should be called
+ * with the OCaml runtime. */
+static void ocaml_gstreamer_report_exception(const char *from, value ret) {
+  char *exn = caml_format_exception(Extract_exception(ret));
+  g_warning("Exception raised by %s: %s", from, exn);
+  caml_stat_free(exn);
+}
+
+/* OCaml values referenced by GStreamer objects. Those can be released from any
+ * thread, without holding the OCaml runtime (for instance in destroy
+ * notifiers), so that they are queued and only actually released the next time
+ * [ocaml_roots_collect] is called with the runtime. This is done when new roots
+ * are created, after functions releasing roots synchronously, and at the end
+ * of each major GC cycle (see [collect_roots] in gstreamer.ml). */
+typedef struct ocaml_root {
+  value v;
+  struct ocaml_root *next;
+} ocaml_root;
+
+static GMutex released_roots_mutex;
+static ocaml_root *released_roots = NULL;
+
+static ocaml_root *ocaml_root_create(value v) {
+  ocaml_root *r = malloc(sizeof(ocaml_root));
+
+  if (r == NULL)
+    caml_raise_out_of_memory();
+
+  r->v = v;
+  r->next = NULL;
+  caml_register_generational_global_root(&r->v);
+
+  return r;
+}
+
+static void ocaml_root_release(gpointer user_data) {
+  ocaml_root *r = (ocaml_root *)user_data;
+
+  g_mutex_lock(&released_roots_mutex);
+  r->next = released_roots;
+  released_roots = r;
+  g_mutex_unlock(&released_roots_mutex);
+}
+
+/* Destroy notifier of signal handlers. */
+static void ocaml_root_closure_release(gpointer user_data, GClosure *closure) {
+  ocaml_root_release(user_data);
+}
+
+static void ocaml_roots_collect() {
+  ocaml_root *r, *next;
+
+  g_mutex_lock(&released_roots_mutex);
+  r = released_roots;
+  released_roots = NULL;
+  g_mutex_unlock(&released_roots_mutex);
+
+  while (r) {
+    next = r->next;
+    caml_remove_generational_global_root(&r->v);
+    free(r);
+    r = next;
+  }
+}
+
+CAMLprim value ocaml_gstreamer_collect_roots(value unit) {
+  ocaml_roots_collect();
+  return Val_unit;
+}
+
 CAMLprim value ocaml_gstreamer_init(value _argv) {
   CAMLparam1(_argv);
   char **argv = NULL;
@@ -74,6 +146,12 @@ CAMLprim value ocaml_gstreamer_init(value _argv) {
   CAMLreturn(Val_unit);
 }
 
+CAMLprim value ocaml_gstreamer_registry_fork_set_enabled(value b) {
+  CAMLparam1(b);
+  gst_registry_fork_set_enabled(Bool_val(b));
+  CAMLreturn(Val_unit);
+}
+
 CAMLprim value ocaml_gstreamer_deinit(value unit) {
   CAMLparam0();
 
@@ -114,16 +192,14 @@ static const GstFormat formats[formats_len] = {
 
 static GstFormat format_val(value v) { return formats[Int_val(v)]; }
 
-/*
-static value val_format(GstFormat fmt)
-{
+static value val_format(GstFormat fmt) {
   int i;
   for (i = 0; i < formats_len; i++)
     if (fmt == formats[i])
       return Val_int(i);
-  assert(0);
+  /* Custom formats. */
+  return Val_int(0);
 }
-*/
 
 CAMLprim value ocaml_gstreamer_format_to_string(value _f) {
   GstFormat f = format_val(_f);
@@ -142,6 +218,180 @@ static const GstSeekFlags seek_flags[seek_flags_len] = {
 
 static GstSeekFlags seek_flags_val(value v) { return seek_flags[Int_val(v)]; }
 
+/***** GstCaps *****/
+
+#define Caps_val(v) (*(GstCaps **)Data_custom_val(v))
+
+static void finalize_caps(value v) {
+  GstCaps *c = Caps_val(v);
+  gst_caps_unref(c);
+}
+
+static struct custom_operations caps_ops = {
+    "ocaml_gstreamer_caps",   finalize_caps,
+    custom_compare_default,   custom_hash_default,
+    custom_serialize_default, custom_deserialize_default};
+
+static value value_of_caps(GstCaps *c) {
+  value ans = caml_alloc_custom(&caps_ops, sizeof(GstCaps *), 0, 1);
+  Caps_val(ans) = c;
+  return ans;
+}
+
+CAMLprim value ocaml_gstreamer_caps_to_string(value _c) {
+  CAMLparam1(_c);
+  CAMLlocal1(ans);
+  GstCaps *c = Caps_val(_c);
+  char *s;
+
+  caml_release_runtime_system();
+  s = gst_caps_to_string(c);
+  caml_acquire_runtime_system();
+
+  ans = caml_copy_string(s);
+  free(s);
+
+  CAMLreturn(ans);
+}
+
+CAMLprim value ocaml_gstreamer_caps_of_string(value s) {
+  CAMLparam1(s);
+  GstCaps *c = gst_caps_from_string(String_val(s));
+
+  if (!c)
+    caml_raise_constant(*caml_named_value("gstreamer_exn_failed"));
+
+  CAMLreturn(value_of_caps(c));
+}
+
+static void gvalue_of_caps_field(value v, GValue *gv) {
+  switch (Tag_val(v)) {
+  case 0: // Int
+    g_value_init(gv, G_TYPE_INT);
+    g_value_set_int(gv, Int_val(Field(v, 0)));
+    break;
+
+  case 1: // Double
+    g_value_init(gv, G_TYPE_DOUBLE);
+    g_value_set_double(gv, Double_val(Field(v, 0)));
+    break;
+
+  case 2: // Bool
+    g_value_init(gv, G_TYPE_BOOLEAN);
+    g_value_set_boolean(gv, Bool_val(Field(v, 0)));
+    break;
+
+  case 3: // String
+    g_value_init(gv, G_TYPE_STRING);
+    g_value_set_string(gv, String_val(Field(v, 0)));
+    break;
+
+  case 4: // Fraction
+    g_value_init(gv, GST_TYPE_FRACTION);
+    gst_value_set_fraction(gv, Int_val(Field(v, 0)), Int_val(Field(v, 1)));
+    break;
+
+  default:
+    assert(0);
+  }
+}
+
+CAMLprim value ocaml_gstreamer_caps_make(value name, value fields) {
+  CAMLparam2(name, fields);
+  CAMLlocal1(f);
+  GstCaps *c = gst_caps_new_empty_simple(String_val(name));
+  GstStructure *st = gst_caps_get_structure(c, 0);
+  GValue gv = G_VALUE_INIT;
+  mlsize_t i;
+
+  for (i = 0; i < Wosize_val(fields); i++) {
+    f = Field(fields, i);
+    gvalue_of_caps_field(Field(f, 1), &gv);
+    gst_structure_take_value(st, String_val(Field(f, 0)), &gv);
+    memset(&gv, 0, sizeof(GValue));
+  }
+
+  CAMLreturn(value_of_caps(c));
+}
+
+static GstStructure *caps_structure(GstCaps *c, value _idx) {
+  int idx = Int_val(_idx);
+
+  if (idx < 0 || (guint)idx >= gst_caps_get_size(c))
+    caml_invalid_argument("index out of bounds");
+
+  return gst_caps_get_structure(c, idx);
+}
+
+CAMLprim value ocaml_gstreamer_caps_size(value _c) {
+  CAMLparam1(_c);
+  CAMLreturn(Val_int(gst_caps_get_size(Caps_val(_c))));
+}
+
+CAMLprim value ocaml_gstreamer_caps_name(value _c, value _idx) {
+  CAMLparam2(_c, _idx);
+  GstStructure *st = caps_structure(Caps_val(_c), _idx);
+  CAMLreturn(caml_copy_string(gst_structure_get_name(st)));
+}
+
+CAMLprim value ocaml_gstreamer_caps_get_field(value _c, value _idx,
+                                              value name) {
+  CAMLparam3(_c, _idx, name);
+  CAMLlocal2(ans, v);
+  GstStructure *st = caps_structure(Caps_val(_c), _idx);
+  const GValue *gv = gst_structure_get_value(st, String_val(name));
+  GType type;
+
+  if (!gv)
+    caml_raise_not_found();
+
+  type = G_VALUE_TYPE(gv);
+  if (type == G_TYPE_INT) {
+    ans = caml_alloc(1, 0);
+    Store_field(ans, 0, Val_int(g_value_get_int(gv)));
+  } else if (type == G_TYPE_DOUBLE) {
+    v = caml_copy_double(g_value_get_double(gv));
+    ans = caml_alloc(1, 1);
+    Store_field(ans, 0, v);
+  } else if (type == G_TYPE_BOOLEAN) {
+    ans = caml_alloc(1, 2);
+    Store_field(ans, 0, Val_bool(g_value_get_boolean(gv)));
+  } else if (type == G_TYPE_STRING) {
+    v = caml_copy_string(g_value_get_string(gv));
+    ans = caml_alloc(1, 3);
+    Store_field(ans, 0, v);
+  } else if (type == GST_TYPE_FRACTION) {
+    ans = caml_alloc(2, 4);
+    Store_field(ans, 0, Val_int(gst_value_get_fraction_numerator(gv)));
+    Store_field(ans, 1, Val_int(gst_value_get_fraction_denominator(gv)));
+  } else
+    // Ranges, lists, etc.
+    caml_raise_constant(*caml_named_value("gstreamer_exn_failed"));
+
+  CAMLreturn(ans);
+}
+
+CAMLprim value ocaml_gstreamer_caps_is_fixed(value _c) {
+  CAMLparam1(_c);
+  CAMLreturn(Val_bool(gst_caps_is_fixed(Caps_val(_c))));
+}
+
+CAMLprim value ocaml_gstreamer_caps_is_empty(value _c) {
+  CAMLparam1(_c);
+  CAMLreturn(Val_bool(gst_caps_is_empty(Caps_val(_c))));
+}
+
+CAMLprim value ocaml_gstreamer_caps_intersect(value _c1, value _c2) {
+  CAMLparam2(_c1, _c2);
+  GstCaps *c;
+
+  caml_release_runtime_system();
+  c = gst_caps_intersect(Caps_val(_c1), Caps_val(_c2));
+  caml_acquire_runtime_system();
+
+  CAMLreturn(value_of_caps(c));
+}
+
 /***** Element ******/
 
 #define Element_val(v) (*(GstElement **)Data_custom_val(v))
@@ -183,6 +433,314 @@ CAMLprim value ocaml_gstreamer_element_set_property_bool(value e, value l,
   CAMLreturn(Val_unit);
 }
 
+static GParamSpec *find_property(GstElement *e, const char *name) {
+  GParamSpec *pspec =
+      g_object_class_find_property(G_OBJECT_GET_CLASS(e), name);
+
+  if (!pspec)
+    caml_raise_not_found();
+
+  return pspec;
+}
+
+/* Initialize gv with the type of the property and set it to the OCaml
+   property value, converting if needed. Returns FALSE if the value cannot be
+   converted, in which case gv is left unset. */
+static gboolean gvalue_of_property_value(GParamSpec *pspec, value v,
+                                         GValue *gv) {
+  GType type = G_PARAM_SPEC_VALUE_TYPE(pspec);
+  GValue src = G_VALUE_INIT;
+  gboolean ok;
+
+  g_value_init(gv, type);
+
+  switch (Tag_val(v)) {
+  case 0: // Int
+  case 6: // Enum
+    if (G_TYPE_IS_ENUM(type)) {
+      g_value_set_enum(gv, Int_val(Field(v, 0)));
+      return TRUE;
+    }
+    if (G_TYPE_IS_FLAGS(type)) {
+      g_value_set_flags(gv, Int_val(Field(v, 0)));
+      return TRUE;
+    }
+    g_value_init(&src, G_TYPE_INT64);
+    g_value_set_int64(&src, Long_val(Field(v, 0)));
+    break;
+
+  case 1: // Int64
+    g_value_init(&src, G_TYPE_INT64);
+    g_value_set_int64(&src, Int64_val(Field(v, 0)));
+    break;
+
+  case 2: // Uint64
+    g_value_init(&src, G_TYPE_UINT64);
+    g_value_set_uint64(&src, (guint64)Int64_val(Field(v, 0)));
+    break;
+
+  case 3: // Double
+    g_value_init(&src, G_TYPE_DOUBLE);
+    g_value_set_double(&src, Double_val(Field(v, 0)));
+    break;
+
+  case 4: // Bool
+    g_value_init(&src, G_TYPE_BOOLEAN);
+    g_value_set_boolean(&src, Bool_val(Field(v, 0)));
+    break;
+
+  case 5: // String
+    if (type != G_TYPE_STRING) {
+      ok = gst_value_deserialize(gv, String_val(Field(v, 0)));
+      if (!ok)
+        g_value_unset(gv);
+      return ok;
+    }
+    g_value_init(&src, G_TYPE_STRING);
+    g_value_set_string(&src, String_val(Field(v, 0)));
+    break;
+
+  case 7: // Caps
+    g_value_init(&src, GST_TYPE_CAPS);
+    g_value_set_boxed(&src, Caps_val(Field(v, 0)));
+    break;
+
+  default:
+    assert(0);
+  }
+
+  ok = g_value_type_transformable(G_VALUE_TYPE(&src), type) &&
+       g_value_transform(&src, gv);
+  g_value_unset(&src);
+  if (!ok)
+    g_value_unset(gv);
+
+  return ok;
+}
+
+/* Returns unit if the type of the value is not supported. Integers which do
+ * not fit in an OCaml integer are returned as Int64 or Uint64 instead of being
+ * truncated. */
+static value property_value_of_gvalue(const GValue *gv) {
+  CAMLparam0();
+  CAMLlocal2(ans, v);
+  gint64 n;
+  guint64 u;
+  int tag;
+
+  switch (G_TYPE_FUNDAMENTAL(G_VALUE_TYPE(gv))) {
+  case G_TYPE_CHAR:
+    tag = 0;
+    v = Val_int(g_value_get_schar(gv));
+    break;
+
+  case G_TYPE_UCHAR:
+    tag = 0;
+    v = Val_int(g_value_get_uchar(gv));
+    break;
+
+  case G_TYPE_INT:
+    tag = 0;
+    v = Val_int(g_value_get_int(gv));
+    break;
+
+  case G_TYPE_LONG:
+    n = g_value_get_long(gv);
+    if (n > Max_long || n < Min_long) {
+      tag = 1;
+      v = caml_copy_int64(n);
+    } else {
+      tag = 0;
+      v = Val_long(n);
+    }
+    break;
+
+  case G_TYPE_UINT:
+  case G_TYPE_ULONG:
+    if (G_VALUE_HOLDS_UINT(gv))
+      u = g_value_get_uint(gv);
+    else
+      u = g_value_get_ulong(gv);
+    if (u > Max_long) {
+      tag = 2;
+      v = caml_copy_int64(u);
+    } else {
+      tag = 0;
+      v = Val_long(u);
+    }
+    break;
+
+  case G_TYPE_INT64:
+    tag = 1;
+    v = caml_copy_int64(g_value_get_int64(gv));
+    break;
+
+  case G_TYPE_UINT64:
+    tag = 2;
+    v = caml_copy_int64(g_value_get_uint64(gv));
+    break;
+
+  case G_TYPE_FLOAT:
+    tag = 3;
+    v = caml_copy_double(g_value_get_float(gv));
+    break;
+
+  case G_TYPE_DOUBLE:
+    tag = 3;
+    v = caml_copy_double(g_value_get_double(gv));
+    break;
+
+  case G_TYPE_BOOLEAN:
+    tag = 4;
+    v = Val_bool(g_value_get_boolean(gv));
+    break;
+
+  case G_TYPE_STRING:
+    tag = 5;
+    v = caml_copy_string(g_value_get_string(gv) ? g_value_get_string(gv) : "");
+    break;
+
+  case G_TYPE_ENUM:
+    tag = 6;
+    v = Val_int(g_value_get_enum(gv));
+    break;
+
+  case G_TYPE_FLAGS:
+    tag = 6;
+    v = Val_int(g_value_get_flags(gv));
+    break;
+
+  default:
+    if (G_VALUE_HOLDS(gv, GST_TYPE_CAPS) && gst_value_get_caps(gv)) {
+      tag = 7;
+      v = value_of_caps(gst_caps_ref((GstCaps *)gst_value_get_caps(gv)));
+      break;
+    }
+    CAMLreturn(Val_unit);
+  }
+
+  ans = caml_alloc(1, tag);
+  Store_field(ans, 0, v);
+
+  CAMLreturn(ans);
+}
+
+CAMLprim value ocaml_gstreamer_element_set_property(value _e, value l,
+                                                    value v) {
+  CAMLparam3(_e, l, v);
+  GstElement *e = Element_val(_e);
+  GParamSpec *pspec = find_property(e, String_val(l));
+  GValue gv = G_VALUE_INIT;
+
+  if (!gvalue_of_property_value(pspec, v, &gv))
+    caml_raise_constant(*caml_named_value("gstreamer_exn_failed"));
+
+  caml_release_runtime_system();
+  g_object_set_property(G_OBJECT(e), pspec->name, &gv);
+  g_value_unset(&gv);
+  caml_acquire_runtime_system();
+
+  CAMLreturn(Val_unit);
+}
+
+typedef struct {
+  GstElement *element;
+  guint n;
+  const char **names;
+  GValue *values;
+} property_batch;
+
+static void free_property_batch(property_batch *batch, int len) {
+  int i;
+  guint j;
+
+  for (i = 0; i < len; i++) {
+    for (j = 0; j < batch[i].n; j++)
+      if (G_IS_VALUE(&batch[i].values[j]))
+        g_value_unset(&batch[i].values[j]);
+    free(batch[i].names);
+    free(batch[i].values);
+    if (batch[i].element)
+      gst_object_unref(batch[i].element);
+  }
+
+  free(batch);
+}
+
+CAMLprim value ocaml_gstreamer_element_set_properties_many(value _batch) {
+  CAMLparam1(_batch);
+  CAMLlocal2(props, p);
+  int len = Wosize_val(_batch);
+  property_batch *batch = calloc(len, sizeof(property_batch));
+  GParamSpec *pspec;
+  int i;
+  guint j;
+
+  if (len && !batch)
+    caml_raise_out_of_memory();
+
+  /* Convert everything first so that nothing is set if a value is invalid. */
+  for (i = 0; i < len; i++) {
+    batch[i].element =
+        gst_object_ref(Element_val(Field(Field(_batch, i), 0)));
+    props = Field(Field(_batch, i), 1);
+    batch[i].n = Wosize_val(props);
+    batch[i].names = calloc(batch[i].n, sizeof(char *));
+    batch[i].values = calloc(batch[i].n, sizeof(GValue));
+    if (batch[i].n && (!batch[i].names || !batch[i].values)) {
+      free_property_batch(batch, i + 1);
+      caml_raise_out_of_memory();
+    }
+
+    for (j = 0; j < batch[i].n; j++) {
+      p = Field(props, j);
+      pspec = g_object_class_find_property(
+          G_OBJECT_GET_CLASS(batch[i].element), String_val(Field(p, 0)));
+      if (!pspec) {
+        free_property_batch(batch, i + 1);
+        caml_raise_not_found();
+      }
+      batch[i].names[j] = pspec->name;
+      if (!gvalue_of_property_value(pspec, Field(p, 1),
+                                    &batch[i].values[j])) {
+        free_property_batch(batch, i + 1);
+        caml_raise_constant(*caml_named_value("gstreamer_exn_failed"));
+      }
+    }
+  }
+
+  caml_release_runtime_system();
+  for (i = 0; i < len; i++)
+    g_object_setv(G_OBJECT(batch[i].element), batch[i].n, batch[i].names,
+                  batch[i].values);
+  free_property_batch(batch, len);
+  caml_acquire_runtime_system();
+
+  CAMLreturn(Val_unit);
+}
+
+CAMLprim value ocaml_gstreamer_element_get_property(value _e, value l) {
+  CAMLparam2(_e, l);
+  CAMLlocal1(ans);
+  GstElement *e = Element_val(_e);
+  GParamSpec *pspec = find_property(e, String_val(l));
+  GValue gv = G_VALUE_INIT;
+
+  g_value_init(&gv, G_PARAM_SPEC_VALUE_TYPE(pspec));
+
+  caml_release_runtime_system();
+  g_object_get_property(G_OBJECT(e), pspec->name, &gv);
+  caml_acquire_runtime_system();
+
+  ans = property_value_of_gvalue(&gv);
+  g_value_unset(&gv);
+
+  if (ans == Val_unit)
+    caml_raise_constant(*caml_named_value("gstreamer_exn_failed"));
+
+  CAMLreturn(ans);
+}
+
 #define states_len 5
 static const GstState states[states_len] = {
     GST_STATE_VOID_PENDING, GST_STATE_NULL, GST_STATE_READY, GST_STATE_PAUSED,
@@ -273,6 +831,32 @@ CAMLprim value ocaml_gstreamer_element_link(value _src, value _dst) {
   CAMLreturn(Val_unit);
 }
 
+CAMLprim value ocaml_gstreamer_element_unlink(value _src, value _dst) {
+  CAMLparam2(_src, _dst);
+  GstElement *src = Element_val(_src);
+  GstElement *dst = Element_val(_dst);
+
+  caml_release_runtime_system();
+  gst_element_unlink(src, dst);
+  caml_acquire_runtime_system();
+
+  CAMLreturn(Val_unit);
+}
+
+CAMLprim value ocaml_gstreamer_element_sync_state_with_parent(value _e) {
+  CAMLparam1(_e);
+  GstElement *e = Element_val(_e);
+  gboolean ret;
+
+  caml_release_runtime_system();
+  ret = gst_element_sync_state_with_parent(e);
+  caml_acquire_runtime_system();
+
+  if (!ret)
+    caml_raise_constant(*caml_named_value("gstreamer_exn_failed"));
+  CAMLreturn(Val_unit);
+}
+
 CAMLprim value ocaml_gstreamer_element_position(value _e, value _fmt) {
   CAMLparam2(_e, _fmt);
   GstElement *e = Element_val(_e);
@@ -341,6 +925,63 @@ CAMLprim value ocaml_gstreamer_element_factory_make(value factname,
   CAMLreturn(ans);
 }
 
+#define Element_factory_val(v) (*(GstElementFactory **)Data_custom_val(v))
+
+static void finalize_element_factory(value v) {
+  gst_object_unref(Element_factory_val(v));
+}
+
+static struct custom_operations element_factory_ops = {
+    "ocaml_gstreamer_element_factory", finalize_element_factory,
+    custom_compare_default,            custom_hash_default,
+    custom_serialize_default,          custom_deserialize_default};
+
+CAMLprim value ocaml_gstreamer_element_factory_find(value name) {
+  CAMLparam1(name);
+  CAMLlocal1(ans);
+  GstElementFactory *f;
+
+  f = gst_element_factory_find(String_val(name));
+  if (!f)
+    caml_raise_not_found();
+
+  ans = caml_alloc_custom(&element_factory_ops, sizeof(GstElementFactory *),
+                          0, 1);
+  Element_factory_val(ans) = f;
+
+  CAMLreturn(ans);
+}
+
+CAMLprim value ocaml_gstreamer_element_factory_preload(value _f) {
+  CAMLparam1(_f);
+  GstElementFactory *f = Element_factory_val(_f);
+  GstPluginFeature *loaded;
+
+  caml_release_runtime_system();
+  loaded = gst_plugin_feature_load(GST_PLUGIN_FEATURE(f));
+  caml_acquire_runtime_system();
+
+  if (!loaded)
+    caml_raise_constant(*caml_named_value("gstreamer_exn_failed"));
+
+  /* Loading might have replaced the feature in the registry. */
+  Element_factory_val(_f) = GST_ELEMENT_FACTORY(loaded);
+  gst_object_unref(f);
+
+  CAMLreturn(Val_unit);
+}
+
+CAMLprim value ocaml_gstreamer_element_factory_create(value _f, value name) {
+  CAMLparam2(_f, name);
+  CAMLlocal1(ans);
+  GstElement *e;
+
+  e = gst_element_factory_create(Element_factory_val(_f), String_val(name));
+  value_of_element(e, ans);
+
+  CAMLreturn(ans);
+}
+
 /**** Message *****/
 
 #define message_types_len 33
@@ -455,6 +1096,27 @@ CAMLprim value ocaml_gstreamer_message_parse_state_changed(value _msg) {
   CAMLreturn(ans);
 }
 
+static value string_of_gvalue(const GValue *val) {
+  CAMLparam0();
+  CAMLlocal1(s);
+
+  if (G_VALUE_HOLDS_STRING(val)) {
+    s = caml_copy_string(g_value_get_string(val));
+  } else if (GST_VALUE_HOLDS_DATE_TIME(val)) {
+    GstDateTime *dt = g_value_get_boxed(val);
+    gchar *dt_str = gst_date_time_to_iso8601_string(dt);
+    s = caml_copy_string(dt_str);
+    g_free(dt_str);
+  } else {
+    // TODO: better typed handling of non-string values?
+    char *vc = g_strdup_value_contents(val);
+    s = caml_copy_string(vc);
+    g_free(vc);
+  }
+
+  CAMLreturn(s);
+}
+
 CAMLprim value ocaml_gstreamer_message_parse_tag(value _msg) {
   CAMLparam1(_msg);
   CAMLlocal4(v, s, t, ans);
@@ -483,19 +1145,7 @@ CAMLprim value ocaml_gstreamer_message_parse_tag(value _msg) {
     v = caml_alloc_tuple(n);
     for (j = 0; j < n; j++) {
       val = gst_tag_list_get_value_index(tags, tag, j);
-      if (G_VALUE_HOLDS_STRING(val)) {
-        s = caml_copy_string(g_value_get_string(val));
-      } else if (GST_VALUE_HOLDS_DATE_TIME(val)) {
-        GstDateTime *dt = g_value_get_boxed(val);
-        gchar *dt_str = gst_date_time_to_iso8601_string(dt);
-        s = caml_copy_string(dt_str);
-        g_free(dt_str);
-      } else {
-        // TODO: better typed handling of non-string values?
-        char *vc = g_strdup_value_contents(val);
-        s = caml_copy_string(vc);
-        free(vc);
-      }
+      s = string_of_gvalue(val);
       Store_field(v, j, s);
     }
     Store_field(t, 1, v);
@@ -508,19 +1158,139 @@ CAMLprim value ocaml_gstreamer_message_parse_tag(value _msg) {
   CAMLreturn(ans);
 }
 
-/**** Main Loop ****/
-
-#define Loop_val(v) (*(GMainLoop **)Data_custom_val(v))
+CAMLprim value ocaml_gstreamer_message_parse_qos(value _msg) {
+  CAMLparam1(_msg);
+  CAMLlocal1(ans);
+  GstMessage *msg = Message_val(_msg);
+  gboolean live;
+  guint64 running_time, stream_time, timestamp, duration, processed, dropped;
+  gint64 jitter;
+  gdouble proportion;
+  gint quality;
+  GstFormat format;
+
+  gst_message_parse_qos(msg, &live, &running_time, &stream_time, &timestamp,
+                        &duration);
+  gst_message_parse_qos_values(msg, &jitter, &proportion, &quality);
+  gst_message_parse_qos_stats(msg, &format, &processed, &dropped);
+
+  ans = caml_alloc_tuple(11);
+  Store_field(ans, 0, Val_bool(live));
+  Store_field(ans, 1, caml_copy_int64(running_time));
+  Store_field(ans, 2, caml_copy_int64(stream_time));
+  Store_field(ans, 3, caml_copy_int64(timestamp));
+  Store_field(ans, 4, caml_copy_int64(duration));
+  Store_field(ans, 5, caml_copy_int64(jitter));
+  Store_field(ans, 6, caml_copy_double(proportion));
+  Store_field(ans, 7, Val_int(quality));
+  Store_field(ans, 8, val_format(format));
+  Store_field(ans, 9, caml_copy_int64(processed));
+  Store_field(ans, 10, caml_copy_int64(dropped));
 
-static void finalize_loop(value v) {
-  GMainLoop *loop = Loop_val(v);
-  g_main_loop_unref(loop);
+  CAMLreturn(ans);
 }
 
-static struct custom_operations loop_ops = {
-    "ocaml_gstreamer_loop",   finalize_loop,
-    custom_compare_default,   custom_hash_default,
-    custom_serialize_default, custom_deserialize_default};
+#define stream_status_types_len 7
+static const GstStreamStatusType stream_status_types[stream_status_types_len] =
+    {GST_STREAM_STATUS_TYPE_CREATE, GST_STREAM_STATUS_TYPE_ENTER,
+     GST_STREAM_STATUS_TYPE_LEAVE,  GST_STREAM_STATUS_TYPE_DESTROY,
+     GST_STREAM_STATUS_TYPE_START,  GST_STREAM_STATUS_TYPE_PAUSE,
+     GST_STREAM_STATUS_TYPE_STOP};
+
+static value val_of_stream_status_type(GstStreamStatusType type) {
+  int i;
+  for (i = 0; i < stream_status_types_len; i++) {
+    if (type == stream_status_types[i])
+      return Val_int(i);
+  }
+  assert(0);
+}
+
+CAMLprim value ocaml_gstreamer_message_parse_stream_status(value _msg) {
+  CAMLparam1(_msg);
+  CAMLlocal1(ans);
+  GstStreamStatusType type;
+  GstElement *owner;
+
+  gst_message_parse_stream_status(Message_val(_msg), &type, &owner);
+
+  ans = caml_alloc_tuple(2);
+  Store_field(ans, 0, val_of_stream_status_type(type));
+  Store_field(ans, 1, caml_copy_string(GST_ELEMENT_NAME(owner)));
+
+  CAMLreturn(ans);
+}
+
+#define progress_types_len 5
+static const GstProgressType progress_types[progress_types_len] = {
+    GST_PROGRESS_TYPE_START, GST_PROGRESS_TYPE_CONTINUE,
+    GST_PROGRESS_TYPE_COMPLETE, GST_PROGRESS_TYPE_CANCELED,
+    GST_PROGRESS_TYPE_ERROR};
+
+static value val_of_progress_type(GstProgressType type) {
+  int i;
+  for (i = 0; i < progress_types_len; i++) {
+    if (type == progress_types[i])
+      return Val_int(i);
+  }
+  assert(0);
+}
+
+CAMLprim value ocaml_gstreamer_message_parse_progress(value _msg) {
+  CAMLparam1(_msg);
+  CAMLlocal1(ans);
+  GstProgressType type;
+  gchar *code, *text;
+
+  gst_message_parse_progress(Message_val(_msg), &type, &code, &text);
+
+  ans = caml_alloc_tuple(3);
+  Store_field(ans, 0, val_of_progress_type(type));
+  Store_field(ans, 1, caml_copy_string(code));
+  Store_field(ans, 2, caml_copy_string(text));
+  g_free(code);
+  g_free(text);
+
+  CAMLreturn(ans);
+}
+
+CAMLprim value ocaml_gstreamer_message_parse_structure(value _msg) {
+  CAMLparam1(_msg);
+  CAMLlocal3(ans, fields, f);
+  const GstStructure *st = gst_message_get_structure(Message_val(_msg));
+  const gchar *name;
+  int i, n;
+
+  n = st ? gst_structure_n_fields(st) : 0;
+  fields = caml_alloc_tuple(n);
+  for (i = 0; i < n; i++) {
+    name = gst_structure_nth_field_name(st, i);
+    f = caml_alloc_tuple(2);
+    Store_field(f, 0, caml_copy_string(name));
+    Store_field(f, 1, string_of_gvalue(gst_structure_get_value(st, name)));
+    Store_field(fields, i, f);
+  }
+
+  ans = caml_alloc_tuple(2);
+  Store_field(ans, 0, caml_copy_string(st ? gst_structure_get_name(st) : ""));
+  Store_field(ans, 1, fields);
+
+  CAMLreturn(ans);
+}
+
+/**** Main Loop ****/
+
+#define Loop_val(v) (*(GMainLoop **)Data_custom_val(v))
+
+static void finalize_loop(value v) {
+  GMainLoop *loop = Loop_val(v);
+  g_main_loop_unref(loop);
+}
+
+static struct custom_operations loop_ops = {
+    "ocaml_gstreamer_loop",   finalize_loop,
+    custom_compare_default,   custom_hash_default,
+    custom_serialize_default, custom_deserialize_default};
 
 CAMLprim value ocaml_gstreamer_loop_create(value unit) {
   CAMLparam0();
@@ -639,8 +1409,243 @@ CAMLprim value ocaml_gstreamer_bus_timed_pop_filtered(value _bus,
   CAMLreturn(ans);
 }
 
+/* Call a function on all pending messages matching the filter, until there is
+ * none left. Other messages are dropped without allocating anything, and no
+ * intermediate array is built. */
+CAMLprim value ocaml_gstreamer_bus_drain_filtered(value _bus, value _filter,
+                                                  value _f) {
+  CAMLparam3(_bus, _filter, _f);
+  CAMLlocal1(m);
+  GstBus *bus = Bus_val(_bus);
+  GstMessageType filter = 0;
+  GstMessage *msg;
+  int i;
+
+  for (i = 0; i < Wosize_val(_filter); i++)
+    filter |= message_type_of_int(Int_val(Field(_filter, i)));
+
+  while (1) {
+    caml_release_runtime_system();
+    while ((msg = gst_bus_pop(bus)) && !(GST_MESSAGE_TYPE(msg) & filter))
+      gst_message_unref(msg);
+    caml_acquire_runtime_system();
+
+    if (!msg)
+      break;
+
+    value_of_message(msg, m);
+    caml_callback(_f, m);
+  }
+
+  CAMLreturn(Val_unit);
+}
+
+CAMLprim value ocaml_gstreamer_bus_pollfd(value _bus) {
+  CAMLparam1(_bus);
+#ifdef _WIN32
+  /* The descriptor is a handle which cannot be used as a file descriptor. */
+  caml_raise_constant(*caml_named_value("gstreamer_exn_failed"));
+#else
+  GPollFD fd;
+
+  gst_bus_get_pollfd(Bus_val(_bus), &fd);
+
+  CAMLreturn(Val_int(fd.fd));
+#endif
+}
+
+/* Call an OCaml function on a message. This should be called with the OCaml
+ * runtime. */
+static value bus_callback(ocaml_root *cb, GstMessage *msg) {
+  CAMLparam0();
+  CAMLlocal1(m);
+
+  gst_message_ref(msg);
+  value_of_message(msg, m);
+
+  CAMLreturn(caml_callback_exn(cb->v, m));
+}
+
+static gboolean bus_watch_cb(GstBus *bus, GstMessage *msg, gpointer user_data) {
+  value ret;
+  gboolean keep;
+
+  ocaml_gstreamer_register_thread();
+  caml_acquire_runtime_system();
+  ret = bus_callback((ocaml_root *)user_data, msg);
+  if (Is_exception_result(ret)) {
+    ocaml_gstreamer_report_exception("bus watch", ret);
+    keep = FALSE;
+  } else
+    keep = Bool_val(ret);
+  caml_release_runtime_system();
+
+  return keep;
+}
+
+CAMLprim value ocaml_gstreamer_bus_add_watch(value _bus, value _f) {
+  CAMLparam2(_bus, _f);
+  GstBus *bus = Bus_val(_bus);
+  ocaml_root *r;
+  guint id;
+
+  ocaml_roots_collect();
+  r = ocaml_root_create(_f);
+
+  caml_release_runtime_system();
+  id = gst_bus_add_watch_full(bus, G_PRIORITY_DEFAULT, bus_watch_cb, r,
+                              ocaml_root_release);
+  caml_acquire_runtime_system();
+
+  if (!id) {
+    ocaml_root_release(r);
+    caml_raise_constant(*caml_named_value("gstreamer_exn_failed"));
+  }
+
+  CAMLreturn(Val_unit);
+}
+
+CAMLprim value ocaml_gstreamer_bus_remove_watch(value _bus) {
+  CAMLparam1(_bus);
+  GstBus *bus = Bus_val(_bus);
+  gboolean ret;
+
+  caml_release_runtime_system();
+  ret = gst_bus_remove_watch(bus);
+  caml_acquire_runtime_system();
+
+  ocaml_roots_collect();
+
+  if (!ret)
+    caml_raise_constant(*caml_named_value("gstreamer_exn_failed"));
+  CAMLreturn(Val_unit);
+}
+
+#define sync_replies_len 3
+static const GstBusSyncReply sync_replies[sync_replies_len] = {
+    GST_BUS_DROP, GST_BUS_PASS, GST_BUS_ASYNC};
+
+static GstBusSyncReply bus_sync_handler_cb(GstBus *bus, GstMessage *msg,
+                                           gpointer user_data) {
+  value ret;
+  int i = 1;
+
+  ocaml_gstreamer_register_thread();
+  caml_acquire_runtime_system();
+  ret = bus_callback((ocaml_root *)user_data, msg);
+  /* Let the message pass on exceptions. */
+  if (Is_exception_result(ret))
+    ocaml_gstreamer_report_exception("bus sync handler", ret);
+  else
+    i = Int_val(ret);
+  caml_release_runtime_system();
+
+  return sync_replies[i];
+}
+
+CAMLprim value ocaml_gstreamer_bus_set_sync_handler(value _bus, value _f) {
+  CAMLparam2(_bus, _f);
+  GstBus *bus = Bus_val(_bus);
+  ocaml_root *r = NULL;
+
+  ocaml_roots_collect();
+  if (Is_block(_f))
+    r = ocaml_root_create(Field(_f, 0));
+
+  caml_release_runtime_system();
+  /* Sync handlers cannot be directly replaced. */
+  gst_bus_set_sync_handler(bus, NULL, NULL, NULL);
+  if (r)
+    gst_bus_set_sync_handler(bus, bus_sync_handler_cb, r, ocaml_root_release);
+  caml_acquire_runtime_system();
+
+  /* Release the previous handler now. */
+  ocaml_roots_collect();
+
+  CAMLreturn(Val_unit);
+}
+
+static void bus_sync_message_cb(GstBus *bus, GstMessage *msg,
+                                gpointer user_data) {
+  value ret;
+
+  ocaml_gstreamer_register_thread();
+  caml_acquire_runtime_system();
+  ret = bus_callback((ocaml_root *)user_data, msg);
+  if (Is_exception_result(ret))
+    ocaml_gstreamer_report_exception("bus sync message handler", ret);
+  caml_release_runtime_system();
+}
+
+/* Unlike the sync handler, there can be any number of those, and the signal
+ * detail ensures that OCaml is only called for messages of the given type. */
+CAMLprim value ocaml_gstreamer_bus_on_sync_message(value _bus, value _type,
+                                                   value _f) {
+  CAMLparam3(_bus, _type, _f);
+  GstBus *bus = Bus_val(_bus);
+  GstMessageType type = message_type_of_int(Int_val(_type));
+  gchar *signal;
+  ocaml_root *cb;
+  gulong id;
+
+  if (type == GST_MESSAGE_ANY)
+    signal = g_strdup("sync-message");
+  else
+    signal = g_strconcat("sync-message::", gst_message_type_get_name(type),
+                         NULL);
+
+  ocaml_roots_collect();
+  cb = ocaml_root_create(_f);
+
+  caml_release_runtime_system();
+  gst_bus_enable_sync_message_emission(bus);
+  id = g_signal_connect_data(bus, signal, G_CALLBACK(bus_sync_message_cb), cb,
+                             ocaml_root_closure_release, 0);
+  if (!id)
+    gst_bus_disable_sync_message_emission(bus);
+  caml_acquire_runtime_system();
+
+  g_free(signal);
+
+  if (!id) {
+    ocaml_root_release(cb);
+    caml_raise_constant(*caml_named_value("gstreamer_exn_failed"));
+  }
+
+  CAMLreturn(Val_long(id));
+}
+
+CAMLprim value ocaml_gstreamer_bus_disconnect(value _bus, value _id) {
+  CAMLparam2(_bus, _id);
+  GstBus *bus = Bus_val(_bus);
+  gulong id = Long_val(_id);
+
+  caml_release_runtime_system();
+  if (g_signal_handler_is_connected(bus, id)) {
+    g_signal_handler_disconnect(bus, id);
+    gst_bus_disable_sync_message_emission(bus);
+  }
+  caml_acquire_runtime_system();
+
+  ocaml_roots_collect();
+
+  CAMLreturn(Val_unit);
+}
+
 /***** Bin ******/
 
+static void raise_parse_error(GError *err) {
+  CAMLparam0();
+  CAMLlocal1(_err);
+
+  _err = caml_copy_string(err ? err->message : "Could not parse pipeline");
+  if (err)
+    g_error_free(err);
+  caml_raise_with_arg(*caml_named_value("gstreamer_exn_error"), _err);
+
+  CAMLnoreturn;
+}
+
 #define Bin_val(v) GST_BIN(Element_val(v))
 
 CAMLprim value ocaml_gstreamer_bin_add(value _bin, value _e) {
@@ -661,6 +1666,45 @@ CAMLprim value ocaml_gstreamer_bin_add(value _bin, value _e) {
   CAMLreturn(Val_unit);
 }
 
+CAMLprim value ocaml_gstreamer_bin_remove(value _bin, value _e) {
+  CAMLparam2(_bin, _e);
+  GstBin *bin = Bin_val(_bin);
+  GstElement *e = Element_val(_e);
+  gboolean ret;
+
+  caml_release_runtime_system();
+  ret = gst_bin_remove(bin, e);
+  caml_acquire_runtime_system();
+
+  if (!ret)
+    caml_raise_constant(*caml_named_value("gstreamer_exn_failed"));
+  CAMLreturn(Val_unit);
+}
+
+CAMLprim value ocaml_gstreamer_bin_parse(value s) {
+  CAMLparam1(s);
+  CAMLlocal1(ans);
+  gchar *description = g_strdup(String_val(s));
+  GError *err = NULL;
+  GstElement *e;
+
+  caml_release_runtime_system();
+  e = gst_parse_bin_from_description_full(
+      description, TRUE, NULL, GST_PARSE_FLAG_FATAL_ERRORS, &err);
+  caml_acquire_runtime_system();
+
+  g_free(description);
+  if (err || !e) {
+    if (e)
+      gst_object_unref(e);
+    raise_parse_error(err);
+  }
+
+  value_of_element(e, ans);
+
+  CAMLreturn(ans);
+}
+
 CAMLprim value ocaml_gstreamer_bin_get_by_name(value _bin, value _name) {
   CAMLparam2(_bin, _name);
   CAMLlocal1(ans);
@@ -708,6 +1752,33 @@ CAMLprim value ocaml_gstreamer_pipeline_parse_launch(value s) {
   CAMLreturn(ans);
 }
 
+/* Same as parse_launch, but fails instead of returning a partial pipeline when
+ * an element cannot be created. */
+CAMLprim value ocaml_gstreamer_pipeline_parse_launch_full(value s) {
+  CAMLparam1(s);
+  CAMLlocal1(ans);
+  gchar *description = g_strdup(String_val(s));
+  GError *err = NULL;
+  GstElement *e;
+
+  caml_release_runtime_system();
+  e = gst_parse_launch_full(description, NULL, GST_PARSE_FLAG_FATAL_ERRORS,
+                            &err);
+  caml_acquire_runtime_system();
+
+  g_free(description);
+
+  if (err || !e) {
+    if (e)
+      gst_object_unref(e);
+    raise_parse_error(err);
+  }
+
+  value_of_element(e, ans);
+
+  CAMLreturn(ans);
+}
+
 /***** Buffer ******/
 
 #define Buffer_val(v) (*(GstBuffer **)Data_custom_val(v))
@@ -840,6 +1911,43 @@ CAMLprim value ocaml_gstreamer_buffer_of_data(value _ba, value _off,
   CAMLreturn(ans);
 }
 
+/* Create a memory which is directly the one of the bigarray, which is kept
+ * alive until GStreamer releases the memory. */
+static GstMemory *memory_of_data_wrapped(value _ba, int ofs, int len) {
+  ocaml_root *r;
+
+  assert(ofs + len <= Caml_ba_array_val(_ba)->dim[0]);
+
+  r = ocaml_root_create(_ba);
+
+  return gst_memory_new_wrapped(GST_MEMORY_FLAG_READONLY, Caml_ba_data_val(_ba),
+                                Caml_ba_array_val(_ba)->dim[0], ofs, len, r,
+                                ocaml_root_release);
+}
+
+static GstBuffer *buffer_of_data_wrapped(value _ba, int ofs, int len) {
+  GstBuffer *gstbuf;
+
+  ocaml_roots_collect();
+  gstbuf = gst_buffer_new();
+  gst_buffer_append_memory(gstbuf, memory_of_data_wrapped(_ba, ofs, len));
+
+  return gstbuf;
+}
+
+CAMLprim value ocaml_gstreamer_buffer_of_data_wrapped(value _ba, value _off,
+                                                      value _len) {
+  CAMLparam1(_ba);
+  CAMLlocal1(ans);
+  GstBuffer *gstbuf;
+
+  gstbuf = buffer_of_data_wrapped(_ba, Int_val(_off), Int_val(_len));
+
+  value_of_buffer(gstbuf, ans);
+
+  CAMLreturn(ans);
+}
+
 CAMLprim value ocaml_gstreamer_buffer_of_data_list(value dol) {
   CAMLparam1(dol);
   CAMLlocal2(tmp, ans);
@@ -891,6 +1999,27 @@ CAMLprim value ocaml_gstreamer_buffer_of_data_list(value dol) {
   CAMLreturn(ans);
 }
 
+CAMLprim value ocaml_gstreamer_buffer_of_data_list_wrapped(value dol) {
+  CAMLparam1(dol);
+  CAMLlocal3(tmp, chunk, ans);
+  GstBuffer *gstbuf;
+
+  ocaml_roots_collect();
+  gstbuf = gst_buffer_new();
+
+  tmp = dol;
+  while (Is_block(tmp)) {
+    chunk = Field(tmp, 0);
+    gst_buffer_append_memory(
+        gstbuf, memory_of_data_wrapped(Field(chunk, 0), Int_val(Field(chunk, 1)),
+                                       Int_val(Field(chunk, 2))));
+    tmp = Field(tmp, 1);
+  }
+
+  value_of_buffer(gstbuf, ans);
+  CAMLreturn(ans);
+}
+
 CAMLprim value ocaml_gstreamer_buffer_to_string(value _buf) {
   CAMLparam1(_buf);
   CAMLlocal1(ans);
@@ -941,21 +2070,154 @@ CAMLprim value ocaml_gstreamer_buffer_to_data(value _buf) {
   CAMLreturn(ans);
 }
 
-CAMLprim value ocaml_gstreamer_buffer_set_presentation_time(value _buf,
-                                                            value _t) {
-  CAMLparam2(_buf, _t);
-  GstBuffer *b = Buffer_val(_buf);
-  GstClockTime t = Int64_val(_t);
-
-  b->pts = t;
-
-  CAMLreturn(Val_unit);
+/* A buffer (or one of its memories) mapped in memory, whose contents are
+ * directly exposed as a bigarray. The buffer (or memory) is kept alive and
+ * mapped until [unmap] is called or the mapping is finalized. */
+typedef struct {
+  GstBuffer *buffer;
+  GstMemory *memory;
+  GstMapInfo map;
+  int mapped;
+} mapping;
+
+#define Mapping_val(v) (*(mapping **)Data_custom_val(v))
+
+/* Total size of mapped memory after which we hurry the GC up. */
+#define MAPPING_MAX_MEM (64 * 1024 * 1024)
+
+static void mapping_unmap(mapping *m) {
+  if (!m->mapped)
+    return;
+  if (m->buffer) {
+    gst_buffer_unmap(m->buffer, &m->map);
+    gst_buffer_unref(m->buffer);
+  } else {
+    gst_memory_unmap(m->memory, &m->map);
+    gst_memory_unref(m->memory);
+  }
+  m->mapped = 0;
 }
 
-CAMLprim value ocaml_gstreamer_buffer_set_decoding_time(value _buf, value _t) {
-  CAMLparam2(_buf, _t);
-  GstBuffer *b = Buffer_val(_buf);
-  GstClockTime t = Int64_val(_t);
+static void finalize_mapping(value v) {
+  mapping *m = Mapping_val(v);
+  mapping_unmap(m);
+  free(m);
+}
+
+static struct custom_operations mapping_ops = {
+    "ocaml_gstreamer_mapping", finalize_mapping,
+    custom_compare_default,    custom_hash_default,
+    custom_serialize_default,  custom_deserialize_default};
+
+CAMLprim value ocaml_gstreamer_buffer_map(value _buf) {
+  CAMLparam1(_buf);
+  CAMLlocal3(m, data, ans);
+  GstBuffer *buf = Buffer_val(_buf);
+  mapping *mp = malloc(sizeof(mapping));
+  gboolean ret;
+
+  if (mp == NULL)
+    caml_raise_out_of_memory();
+
+  caml_release_runtime_system();
+  ret = gst_buffer_map(buf, &mp->map, GST_MAP_READ);
+  caml_acquire_runtime_system();
+
+  if (!ret) {
+    free(mp);
+    caml_raise_out_of_memory();
+  }
+
+  mp->buffer = gst_buffer_ref(buf);
+  mp->memory = NULL;
+  mp->mapped = 1;
+
+  intnat len = mp->map.size;
+
+  m = caml_alloc_custom(&mapping_ops, sizeof(mapping *), len, MAPPING_MAX_MEM);
+  Mapping_val(m) = mp;
+  data = caml_ba_alloc(CAML_BA_C_LAYOUT | CAML_BA_UINT8 | CAML_BA_EXTERNAL, 1,
+                       mp->map.data, &len);
+
+  ans = caml_alloc_tuple(2);
+  Store_field(ans, 0, m);
+  Store_field(ans, 1, data);
+
+  CAMLreturn(ans);
+}
+
+CAMLprim value ocaml_gstreamer_buffer_map_memories(value _buf) {
+  CAMLparam1(_buf);
+  CAMLlocal4(m, data, pair, ans);
+  GstBuffer *buf = Buffer_val(_buf);
+  guint i, n = gst_buffer_n_memory(buf);
+  mapping *mp;
+  gboolean ret;
+  intnat len;
+
+  ans = caml_alloc_tuple(n);
+  for (i = 0; i < n; i++) {
+    mp = malloc(sizeof(mapping));
+    if (mp == NULL)
+      caml_raise_out_of_memory();
+
+    mp->buffer = NULL;
+    mp->memory = gst_buffer_get_memory(buf, i);
+
+    caml_release_runtime_system();
+    ret = gst_memory_map(mp->memory, &mp->map, GST_MAP_READ);
+    caml_acquire_runtime_system();
+
+    if (!ret) {
+      gst_memory_unref(mp->memory);
+      free(mp);
+      caml_raise_out_of_memory();
+    }
+
+    mp->mapped = 1;
+    len = mp->map.size;
+
+    m = caml_alloc_custom(&mapping_ops, sizeof(mapping *), len,
+                          MAPPING_MAX_MEM);
+    Mapping_val(m) = mp;
+    data = caml_ba_alloc(CAML_BA_C_LAYOUT | CAML_BA_UINT8 | CAML_BA_EXTERNAL,
+                         1, mp->map.data, &len);
+
+    pair = caml_alloc_tuple(2);
+    Store_field(pair, 0, m);
+    Store_field(pair, 1, data);
+    Store_field(ans, i, pair);
+  }
+
+  CAMLreturn(ans);
+}
+
+CAMLprim value ocaml_gstreamer_buffer_unmap(value _m) {
+  CAMLparam1(_m);
+  mapping *m = Mapping_val(_m);
+
+  caml_release_runtime_system();
+  mapping_unmap(m);
+  caml_acquire_runtime_system();
+
+  CAMLreturn(Val_unit);
+}
+
+CAMLprim value ocaml_gstreamer_buffer_set_presentation_time(value _buf,
+                                                            value _t) {
+  CAMLparam2(_buf, _t);
+  GstBuffer *b = Buffer_val(_buf);
+  GstClockTime t = Int64_val(_t);
+
+  b->pts = t;
+
+  CAMLreturn(Val_unit);
+}
+
+CAMLprim value ocaml_gstreamer_buffer_set_decoding_time(value _buf, value _t) {
+  CAMLparam2(_buf, _t);
+  GstBuffer *b = Buffer_val(_buf);
+  GstClockTime t = Int64_val(_t);
 
   b->dts = t;
 
@@ -967,425 +2229,2181 @@ CAMLprim value ocaml_gstreamer_buffer_set_duration(value _buf, value _t) {
   GstBuffer *b = Buffer_val(_buf);
   GstClockTime t = Int64_val(_t);
 
-  b->duration = t;
+  b->duration = t;
+
+  CAMLreturn(Val_unit);
+}
+
+CAMLprim value ocaml_gstreamer_buffer_get_presentation_time(value _buf) {
+  CAMLparam1(_buf);
+  CAMLreturn(caml_copy_int64(GST_BUFFER_PTS(Buffer_val(_buf))));
+}
+
+CAMLprim value ocaml_gstreamer_buffer_get_decoding_time(value _buf) {
+  CAMLparam1(_buf);
+  CAMLreturn(caml_copy_int64(GST_BUFFER_DTS(Buffer_val(_buf))));
+}
+
+CAMLprim value ocaml_gstreamer_buffer_get_duration(value _buf) {
+  CAMLparam1(_buf);
+  CAMLreturn(caml_copy_int64(GST_BUFFER_DURATION(Buffer_val(_buf))));
+}
+
+CAMLprim value ocaml_gstreamer_buffer_get_offset(value _buf) {
+  CAMLparam1(_buf);
+  CAMLreturn(caml_copy_int64(GST_BUFFER_OFFSET(Buffer_val(_buf))));
+}
+
+CAMLprim value ocaml_gstreamer_buffer_get_offset_end(value _buf) {
+  CAMLparam1(_buf);
+  CAMLreturn(caml_copy_int64(GST_BUFFER_OFFSET_END(Buffer_val(_buf))));
+}
+
+#define buffer_flags_len 12
+static const GstBufferFlags buffer_flags[buffer_flags_len] = {
+    GST_BUFFER_FLAG_LIVE,       GST_BUFFER_FLAG_DISCONT,
+    GST_BUFFER_FLAG_RESYNC,     GST_BUFFER_FLAG_CORRUPTED,
+    GST_BUFFER_FLAG_MARKER,     GST_BUFFER_FLAG_HEADER,
+    GST_BUFFER_FLAG_GAP,        GST_BUFFER_FLAG_DROPPABLE,
+    GST_BUFFER_FLAG_DELTA_UNIT, GST_BUFFER_FLAG_TAG_MEMORY,
+    GST_BUFFER_FLAG_SYNC_AFTER, GST_BUFFER_FLAG_NON_DROPPABLE};
+
+CAMLprim value ocaml_gstreamer_buffer_get_flags(value _buf) {
+  CAMLparam1(_buf);
+  CAMLlocal2(ans, l);
+  GstBuffer *b = Buffer_val(_buf);
+  int i;
+
+  ans = Val_emptylist;
+  for (i = buffer_flags_len - 1; i >= 0; i--)
+    if (GST_BUFFER_FLAG_IS_SET(b, buffer_flags[i])) {
+      l = caml_alloc_tuple(2);
+      Store_field(l, 0, Val_int(i));
+      Store_field(l, 1, ans);
+      ans = l;
+    }
+
+  CAMLreturn(ans);
+}
+
+/***** Sample *****/
+
+#define Sample_val(v) (*(GstSample **)Data_custom_val(v))
+
+static void finalize_sample(value v) {
+  GstSample *s = Sample_val(v);
+  gst_sample_unref(s);
+}
+
+static struct custom_operations sample_ops = {
+    "ocaml_gstreamer_sample", finalize_sample,
+    custom_compare_default,   custom_hash_default,
+    custom_serialize_default, custom_deserialize_default};
+
+#define value_of_sample(s, ans)                                                \
+  ans = caml_alloc_custom(&sample_ops, sizeof(GstSample *), 0, 1);             \
+  Sample_val(ans) = s;
+
+CAMLprim value ocaml_gstreamer_sample_buffer(value _s) {
+  CAMLparam1(_s);
+  CAMLlocal1(ans);
+  GstBuffer *b = gst_sample_get_buffer(Sample_val(_s));
+
+  if (!b)
+    caml_raise_not_found();
+
+  gst_buffer_ref(b);
+  value_of_buffer(b, ans);
+
+  CAMLreturn(ans);
+}
+
+CAMLprim value ocaml_gstreamer_sample_caps(value _s) {
+  CAMLparam1(_s);
+  GstCaps *c = gst_sample_get_caps(Sample_val(_s));
+
+  if (!c)
+    caml_raise_not_found();
+
+  CAMLreturn(value_of_caps(gst_caps_ref(c)));
+}
+
+CAMLprim value ocaml_gstreamer_sample_segment(value _s) {
+  CAMLparam1(_s);
+  CAMLlocal1(ans);
+  GstSegment *seg = gst_sample_get_segment(Sample_val(_s));
+
+  if (!seg)
+    caml_raise_not_found();
+
+  ans = caml_alloc_tuple(10);
+  Store_field(ans, 0, val_format(seg->format));
+  Store_field(ans, 1, caml_copy_double(seg->rate));
+  Store_field(ans, 2, caml_copy_double(seg->applied_rate));
+  Store_field(ans, 3, caml_copy_int64(seg->base));
+  Store_field(ans, 4, caml_copy_int64(seg->offset));
+  Store_field(ans, 5, caml_copy_int64(seg->start));
+  Store_field(ans, 6, caml_copy_int64(seg->stop));
+  Store_field(ans, 7, caml_copy_int64(seg->time));
+  Store_field(ans, 8, caml_copy_int64(seg->position));
+  Store_field(ans, 9, caml_copy_int64(seg->duration));
+
+  CAMLreturn(ans);
+}
+
+/***** Pad *****/
+
+#define Pad_val(v) (*(GstPad **)Data_custom_val(v))
+
+static void finalize_pad(value v) {
+  GstPad *p = Pad_val(v);
+  gst_object_unref(p);
+}
+
+static struct custom_operations pad_ops = {
+    "ocaml_gstreamer_pad",    finalize_pad,
+    custom_compare_default,   custom_hash_default,
+    custom_serialize_default, custom_deserialize_default};
+
+#define value_of_pad(p, ans)                                                   \
+  if (!p)                                                                      \
+    caml_raise_not_found();                                                    \
+  ans = caml_alloc_custom(&pad_ops, sizeof(GstPad *), 0, 1);                   \
+  Pad_val(ans) = p;
+
+CAMLprim value ocaml_gstreamer_pad_of_element(value _e, value _name) {
+  CAMLparam2(_e, _name);
+  CAMLlocal1(ans);
+  GstPad *p;
+
+  p = gst_element_get_static_pad(Element_val(_e), String_val(_name));
+  value_of_pad(p, ans);
+
+  CAMLreturn(ans);
+}
+
+CAMLprim value ocaml_gstreamer_pad_name(value _p) {
+  CAMLparam1(_p);
+  CAMLlocal1(ans);
+  gchar *name = gst_pad_get_name(Pad_val(_p));
+
+  ans = caml_copy_string(name);
+  g_free(name);
+
+  CAMLreturn(ans);
+}
+
+CAMLprim value ocaml_gstreamer_pad_current_caps(value _p) {
+  CAMLparam1(_p);
+  GstCaps *caps = gst_pad_get_current_caps(Pad_val(_p));
+
+  if (!caps)
+    caml_raise_not_found();
+
+  CAMLreturn(value_of_caps(caps));
+}
+
+CAMLprim value ocaml_gstreamer_pad_peer(value _p) {
+  CAMLparam1(_p);
+  CAMLlocal1(ans);
+  GstPad *p = gst_pad_get_peer(Pad_val(_p));
+
+  value_of_pad(p, ans);
+
+  CAMLreturn(ans);
+}
+
+CAMLprim value ocaml_gstreamer_pad_is_linked(value _p) {
+  CAMLparam1(_p);
+  CAMLreturn(Val_bool(gst_pad_is_linked(Pad_val(_p))));
+}
+
+CAMLprim value ocaml_gstreamer_pad_link(value _src, value _sink) {
+  CAMLparam2(_src, _sink);
+  GstPad *src = Pad_val(_src);
+  GstPad *sink = Pad_val(_sink);
+  GstPadLinkReturn ret;
+
+  caml_release_runtime_system();
+  ret = gst_pad_link(src, sink);
+  caml_acquire_runtime_system();
+
+  if (ret != GST_PAD_LINK_OK)
+    caml_raise_constant(*caml_named_value("gstreamer_exn_failed"));
+  CAMLreturn(Val_unit);
+}
+
+CAMLprim value ocaml_gstreamer_pad_unlink(value _src, value _sink) {
+  CAMLparam2(_src, _sink);
+  GstPad *src = Pad_val(_src);
+  GstPad *sink = Pad_val(_sink);
+  gboolean ret;
+
+  caml_release_runtime_system();
+  ret = gst_pad_unlink(src, sink);
+  caml_acquire_runtime_system();
+
+  if (!ret)
+    caml_raise_constant(*caml_named_value("gstreamer_exn_failed"));
+  CAMLreturn(Val_unit);
+}
+
+CAMLprim value ocaml_gstreamer_pad_request(value _e, value _name) {
+  CAMLparam2(_e, _name);
+  CAMLlocal1(ans);
+  GstElement *e = Element_val(_e);
+  gchar *name = g_strdup(String_val(_name));
+  GstPad *p;
+
+  caml_release_runtime_system();
+#if GST_CHECK_VERSION(1, 20, 0)
+  p = gst_element_request_pad_simple(e, name);
+#else
+  p = gst_element_get_request_pad(e, name);
+#endif
+  caml_acquire_runtime_system();
+
+  g_free(name);
+  value_of_pad(p, ans);
+
+  CAMLreturn(ans);
+}
+
+CAMLprim value ocaml_gstreamer_pad_release(value _e, value _p) {
+  CAMLparam2(_e, _p);
+  GstElement *e = Element_val(_e);
+  GstPad *p = Pad_val(_p);
+
+  caml_release_runtime_system();
+  gst_element_release_request_pad(e, p);
+  caml_acquire_runtime_system();
+
+  CAMLreturn(Val_unit);
+}
+
+CAMLprim value ocaml_gstreamer_pad_of_property(value _e, value _name) {
+  CAMLparam2(_e, _name);
+  CAMLlocal1(ans);
+  GstElement *e = Element_val(_e);
+  GParamSpec *pspec = find_property(e, String_val(_name));
+  GstPad *p = NULL;
+
+  if (!g_type_is_a(G_PARAM_SPEC_VALUE_TYPE(pspec), GST_TYPE_PAD))
+    caml_raise_constant(*caml_named_value("gstreamer_exn_failed"));
+
+  caml_release_runtime_system();
+  g_object_get(e, pspec->name, &p, NULL);
+  caml_acquire_runtime_system();
+
+  value_of_pad(p, ans);
+
+  CAMLreturn(ans);
+}
+
+static value pad_added_callback(ocaml_root *cb, GstPad *pad) {
+  CAMLparam0();
+  CAMLlocal1(p);
+
+  gst_object_ref(pad);
+  value_of_pad(pad, p);
+
+  CAMLreturn(caml_callback_exn(cb->v, p));
+}
+
+static void pad_added_cb(GstElement *e, GstPad *pad, gpointer user_data) {
+  value ret;
+
+  ocaml_gstreamer_register_thread();
+  caml_acquire_runtime_system();
+  ret = pad_added_callback((ocaml_root *)user_data, pad);
+  if (Is_exception_result(ret))
+    ocaml_gstreamer_report_exception("pad-added handler", ret);
+  caml_release_runtime_system();
+}
+
+static void no_more_pads_cb(GstElement *e, gpointer user_data) {
+  value ret;
+
+  ocaml_gstreamer_register_thread();
+  caml_acquire_runtime_system();
+  ret = caml_callback_exn(((ocaml_root *)user_data)->v, Val_unit);
+  if (Is_exception_result(ret))
+    ocaml_gstreamer_report_exception("no-more-pads handler", ret);
+  caml_release_runtime_system();
+}
+
+static value pad_connect_signal(value _e, const char *signal, GCallback f,
+                                value _cb) {
+  CAMLparam2(_e, _cb);
+  GstElement *e = Element_val(_e);
+  ocaml_root *cb;
+  gulong id;
+
+  ocaml_roots_collect();
+  cb = ocaml_root_create(_cb);
+
+  caml_release_runtime_system();
+  id = g_signal_connect_data(e, signal, f, cb, ocaml_root_closure_release, 0);
+  caml_acquire_runtime_system();
+
+  if (!id) {
+    ocaml_root_release(cb);
+    caml_raise_constant(*caml_named_value("gstreamer_exn_failed"));
+  }
+
+  CAMLreturn(Val_long(id));
+}
+
+CAMLprim value ocaml_gstreamer_pad_on_added(value _e, value _cb) {
+  return pad_connect_signal(_e, "pad-added", G_CALLBACK(pad_added_cb), _cb);
+}
+
+CAMLprim value ocaml_gstreamer_pad_on_no_more_pads(value _e, value _cb) {
+  return pad_connect_signal(_e, "no-more-pads", G_CALLBACK(no_more_pads_cb),
+                            _cb);
+}
+
+CAMLprim value ocaml_gstreamer_pad_disconnect(value _e, value _id) {
+  CAMLparam2(_e, _id);
+  GstElement *e = Element_val(_e);
+  gulong id = Long_val(_id);
+
+  caml_release_runtime_system();
+  if (g_signal_handler_is_connected(e, id))
+    g_signal_handler_disconnect(e, id);
+  caml_acquire_runtime_system();
+
+  /* Release the callback now, unless the signal is being emitted. */
+  ocaml_roots_collect();
+
+  CAMLreturn(Val_unit);
+}
+
+#define probe_types_len 11
+static const GstPadProbeType probe_types[probe_types_len] = {
+    GST_PAD_PROBE_TYPE_IDLE,
+    GST_PAD_PROBE_TYPE_BLOCK,
+    GST_PAD_PROBE_TYPE_BUFFER,
+    GST_PAD_PROBE_TYPE_BUFFER_LIST,
+    GST_PAD_PROBE_TYPE_EVENT_DOWNSTREAM,
+    GST_PAD_PROBE_TYPE_EVENT_UPSTREAM,
+    GST_PAD_PROBE_TYPE_EVENT_FLUSH,
+    GST_PAD_PROBE_TYPE_QUERY_DOWNSTREAM,
+    GST_PAD_PROBE_TYPE_QUERY_UPSTREAM,
+    GST_PAD_PROBE_TYPE_PUSH,
+    GST_PAD_PROBE_TYPE_PULL};
+
+/* GST_PAD_PROBE_HANDLED is not exposed: it requires the probe to unref the
+ * buffer or answer the query itself, which OCaml callbacks cannot do. */
+#define probe_returns_len 4
+static const GstPadProbeReturn probe_returns[probe_returns_len] = {
+    GST_PAD_PROBE_OK, GST_PAD_PROBE_DROP, GST_PAD_PROBE_REMOVE,
+    GST_PAD_PROBE_PASS};
+
+/* Native actions of probes. */
+#define PROBE_ACTION_PASS 0
+#define PROBE_ACTION_DROP 1
+#define PROBE_ACTION_COLLECT 2
+#define PROBE_ACTION_CALLBACK 3
+
+/* A probe, which is shared between GStreamer (until the probe is removed) and
+ * OCaml (until the handle is finalized). */
+typedef struct {
+  int action;
+  gint refs;
+  GMutex lock; // Protects the fields below
+  gulong id;   // 0 once removed
+  guint64 buffers;
+  guint64 bytes;
+  guint64 events;
+  guint64 queries;
+  GQueue collected; // Collected buffers
+  guint max_collected;
+  ocaml_root *cb; // Callback for PROBE_ACTION_CALLBACK
+} probe;
+
+#define Probe_val(v) (*(probe **)Data_custom_val(v))
+
+static void probe_unref(gpointer user_data) {
+  probe *p = (probe *)user_data;
+  GstBuffer *b;
+
+  if (!g_atomic_int_dec_and_test(&p->refs))
+    return;
+
+  while ((b = g_queue_pop_head(&p->collected)))
+    gst_buffer_unref(b);
+  if (p->cb)
+    ocaml_root_release(p->cb);
+  g_mutex_clear(&p->lock);
+  free(p);
+}
+
+static void finalize_probe(value v) { probe_unref(Probe_val(v)); }
+
+static struct custom_operations probe_ops = {
+    "ocaml_gstreamer_probe",  finalize_probe,
+    custom_compare_default,   custom_hash_default,
+    custom_serialize_default, custom_deserialize_default};
+
+/* Call the OCaml callback of a probe, with the buffer if there is one. This
+ * should be called with the OCaml runtime. */
+static value pad_probe_callback(ocaml_root *cb, GstBuffer *gstbuf) {
+  CAMLparam0();
+  CAMLlocal2(buf, arg);
+
+  arg = Val_int(0);
+  if (gstbuf) {
+    value_of_buffer(gstbuf, buf);
+    arg = caml_alloc_tuple(1);
+    Store_field(arg, 0, buf);
+  }
+
+  CAMLreturn(caml_callback_exn(cb->v, arg));
+}
+
+static GstPadProbeReturn pad_probe_cb(GstPad *pad, GstPadProbeInfo *info,
+                                      gpointer user_data) {
+  probe *p = (probe *)user_data;
+  GstBuffer *gstbuf = NULL;
+  GstBufferList *gstbuflist = NULL;
+  value ret;
+  int i;
+
+  if (info->type & GST_PAD_PROBE_TYPE_BUFFER)
+    gstbuf = GST_PAD_PROBE_INFO_BUFFER(info);
+  else if (info->type & GST_PAD_PROBE_TYPE_BUFFER_LIST)
+    gstbuflist = GST_PAD_PROBE_INFO_BUFFER_LIST(info);
+
+  g_mutex_lock(&p->lock);
+  if (gstbuf) {
+    p->buffers++;
+    p->bytes += gst_buffer_get_size(gstbuf);
+  } else if (gstbuflist) {
+    p->buffers += gst_buffer_list_length(gstbuflist);
+    p->bytes += gst_buffer_list_calculate_size(gstbuflist);
+  } else if (info->type & GST_PAD_PROBE_TYPE_EVENT_BOTH)
+    p->events++;
+  else if (info->type & GST_PAD_PROBE_TYPE_QUERY_BOTH)
+    p->queries++;
+  if (p->action == PROBE_ACTION_COLLECT && gstbuf &&
+      g_queue_get_length(&p->collected) < p->max_collected)
+    g_queue_push_tail(&p->collected, gst_buffer_ref(gstbuf));
+  g_mutex_unlock(&p->lock);
+
+  switch (p->action) {
+  case PROBE_ACTION_DROP:
+    if (gstbuf || gstbuflist)
+      return GST_PAD_PROBE_DROP;
+    return GST_PAD_PROBE_OK;
+
+  case PROBE_ACTION_CALLBACK:
+    break;
+
+  default:
+    return GST_PAD_PROBE_OK;
+  }
+
+  if (gstbuf)
+    gst_buffer_ref(gstbuf);
+
+  ocaml_gstreamer_register_thread();
+  caml_acquire_runtime_system();
+  ret = pad_probe_callback(p->cb, gstbuf);
+  if (Is_exception_result(ret)) {
+    ocaml_gstreamer_report_exception("pad probe callback", ret);
+    i = 0;
+  } else
+    i = Int_val(ret);
+  caml_release_runtime_system();
+
+  /* GStreamer removes the probe itself. */
+  if (probe_returns[i] == GST_PAD_PROBE_REMOVE) {
+    g_mutex_lock(&p->lock);
+    p->id = 0;
+    g_mutex_unlock(&p->lock);
+  }
+
+  return probe_returns[i];
+}
+
+static value pad_add_probe(value _p, value _types, int action,
+                           guint max_collected, value _cb) {
+  CAMLparam3(_p, _types, _cb);
+  CAMLlocal1(ans);
+  GstPad *pad = Pad_val(_p);
+  GstPadProbeType types = 0;
+  gulong id;
+  probe *p;
+  int i;
+
+  for (i = 0; i < Wosize_val(_types); i++)
+    types |= probe_types[Int_val(Field(_types, i))];
+
+  p = malloc(sizeof(probe));
+  if (p == NULL)
+    caml_raise_out_of_memory();
+
+  p->action = action;
+  /* One reference for GStreamer and one for OCaml. */
+  p->refs = 2;
+  g_mutex_init(&p->lock);
+  p->id = 0;
+  p->buffers = 0;
+  p->bytes = 0;
+  p->events = 0;
+  p->queries = 0;
+  g_queue_init(&p->collected);
+  p->max_collected = max_collected;
+  p->cb = NULL;
+  if (action == PROBE_ACTION_CALLBACK) {
+    ocaml_roots_collect();
+    p->cb = ocaml_root_create(_cb);
+  }
+
+  ans = caml_alloc_custom(&probe_ops, sizeof(probe *), 0, 1);
+  Probe_val(ans) = p;
+
+  caml_release_runtime_system();
+  id = gst_pad_add_probe(pad, types, pad_probe_cb, p, probe_unref);
+  g_mutex_lock(&p->lock);
+  p->id = id;
+  g_mutex_unlock(&p->lock);
+  caml_acquire_runtime_system();
+
+  CAMLreturn(ans);
+}
+
+CAMLprim value ocaml_gstreamer_pad_add_probe(value _p, value _types,
+                                             value _action) {
+  CAMLparam3(_p, _types, _action);
+
+  if (Is_block(_action))
+    CAMLreturn(pad_add_probe(_p, _types, PROBE_ACTION_COLLECT,
+                             Int_val(Field(_action, 0)), Val_unit));
+
+  CAMLreturn(pad_add_probe(_p, _types,
+                           Int_val(_action) == 0 ? PROBE_ACTION_PASS
+                                                 : PROBE_ACTION_DROP,
+                           0, Val_unit));
+}
+
+CAMLprim value ocaml_gstreamer_pad_add_probe_callback(value _p, value _types,
+                                                      value _cb) {
+  CAMLparam3(_p, _types, _cb);
+  CAMLreturn(pad_add_probe(_p, _types, PROBE_ACTION_CALLBACK, 0, _cb));
+}
+
+CAMLprim value ocaml_gstreamer_pad_remove_probe(value _p, value _probe) {
+  CAMLparam2(_p, _probe);
+  GstPad *pad = Pad_val(_p);
+  probe *p = Probe_val(_probe);
+  gulong id;
+
+  caml_release_runtime_system();
+  /* Take the id under the lock so that the probe is removed only once, even
+   * when it is removed from several threads. */
+  g_mutex_lock(&p->lock);
+  id = p->id;
+  p->id = 0;
+  g_mutex_unlock(&p->lock);
+  if (id)
+    gst_pad_remove_probe(pad, id);
+  caml_acquire_runtime_system();
+
+  CAMLreturn(Val_unit);
+}
+
+CAMLprim value ocaml_gstreamer_pad_probe_stats(value _probe) {
+  CAMLparam1(_probe);
+  CAMLlocal1(ans);
+  probe *p = Probe_val(_probe);
+  guint64 buffers, bytes, events, queries;
+
+  g_mutex_lock(&p->lock);
+  buffers = p->buffers;
+  bytes = p->bytes;
+  events = p->events;
+  queries = p->queries;
+  g_mutex_unlock(&p->lock);
+
+  ans = caml_alloc_tuple(4);
+  Store_field(ans, 0, Val_long(buffers));
+  Store_field(ans, 1, Val_long(bytes));
+  Store_field(ans, 2, Val_long(events));
+  Store_field(ans, 3, Val_long(queries));
+
+  CAMLreturn(ans);
+}
+
+CAMLprim value ocaml_gstreamer_pad_probe_collect(value _probe) {
+  CAMLparam1(_probe);
+  CAMLlocal2(ans, buf);
+  probe *p = Probe_val(_probe);
+  GQueue collected = G_QUEUE_INIT;
+  GstBuffer *gstbuf;
+  int i = 0;
+
+  /* Take all the buffers at once in order not to block the streaming thread
+   * while allocating. */
+  g_mutex_lock(&p->lock);
+  collected = p->collected;
+  g_queue_init(&p->collected);
+  g_mutex_unlock(&p->lock);
+
+  ans = caml_alloc_tuple(g_queue_get_length(&collected));
+  while ((gstbuf = g_queue_pop_head(&collected))) {
+    value_of_buffer(gstbuf, buf);
+    Store_field(ans, i++, buf);
+  }
+
+  CAMLreturn(ans);
+}
+
+/***** Appsrc *****/
+
+typedef struct {
+  GstAppSrc *appsrc;
+  value element;
+  value need_data_cb;   // Callback function
+  gulong need_data_hid; // Callback handler ID
+} appsrc;
+
+#define Appsrc_val(v) (*(appsrc **)Data_custom_val(v))
+
+static void disconnect_need_data(appsrc *as) {
+  if (as->need_data_hid) {
+    g_signal_handler_disconnect(as->appsrc, as->need_data_hid);
+    as->need_data_hid = 0;
+  }
+  if (as->need_data_cb) {
+    caml_remove_generational_global_root(&as->need_data_cb);
+    as->need_data_cb = 0;
+  }
+}
+
+static void finalize_appsrc(value v) {
+  appsrc *as = Appsrc_val(v);
+  disconnect_need_data(as);
+  if (as->element) {
+    caml_remove_generational_global_root(&as->element);
+    as->element = 0;
+  }
+  free(as);
+}
+
+static struct custom_operations appsrc_ops = {
+    "ocaml_gstreamer_appsrc", finalize_appsrc,
+    custom_compare_default,   custom_hash_default,
+    custom_serialize_default, custom_deserialize_default};
+
+CAMLprim value ocaml_gstreamer_appsrc_of_element(value _e) {
+  CAMLparam1(_e);
+  CAMLlocal1(ans);
+
+  GstElement *e = Element_val(_e);
+
+  appsrc *as = malloc(sizeof(appsrc));
+  if (as == NULL)
+    caml_raise_out_of_memory();
+
+  as->appsrc = GST_APP_SRC(e);
+  as->need_data_cb = 0;
+  as->need_data_hid = 0;
+  as->element = _e;
+  caml_register_global_root(&as->element);
+
+  ans = caml_alloc_custom(&appsrc_ops, sizeof(appsrc *), 0, 1);
+  Appsrc_val(ans) = as;
+
+  CAMLreturn(ans);
+}
+
+CAMLprim value ocaml_gstreamer_appsrc_to_element(value _as) {
+  CAMLparam1(_as);
+  CAMLlocal1(ans);
+  appsrc *as = Appsrc_val(_as);
+  GstElement *e = GST_ELEMENT(as->appsrc);
+  value_of_element(e, ans);
+  CAMLreturn(ans);
+}
+
+typedef struct {
+  GstBufferPool *pool;
+  guint size;
+} buffer_pool;
+
+#define Buffer_pool_val(v) (*(buffer_pool **)Data_custom_val(v))
+
+static void finalize_buffer_pool(value v) {
+  buffer_pool *bp = Buffer_pool_val(v);
+  /* Buffers still in use hold a reference on the pool and are freed when
+   * released. */
+  gst_buffer_pool_set_active(bp->pool, FALSE);
+  gst_object_unref(bp->pool);
+  free(bp);
+}
+
+static struct custom_operations buffer_pool_ops = {
+    "ocaml_gstreamer_buffer_pool", finalize_buffer_pool,
+    custom_compare_default,        custom_hash_default,
+    custom_serialize_default,      custom_deserialize_default};
+
+CAMLprim value ocaml_gstreamer_appsrc_create_pool(value _size, value _min,
+                                                  value _max) {
+  CAMLparam0();
+  CAMLlocal1(ans);
+  guint size = Int_val(_size);
+  guint min = Int_val(_min);
+  guint max = Int_val(_max);
+  GstBufferPool *pool;
+  GstStructure *config;
+  gboolean ret;
+
+  caml_release_runtime_system();
+  pool = gst_buffer_pool_new();
+  config = gst_buffer_pool_get_config(pool);
+  gst_buffer_pool_config_set_params(config, NULL, size, min, max);
+  ret = gst_buffer_pool_set_config(pool, config) &&
+        gst_buffer_pool_set_active(pool, TRUE);
+  caml_acquire_runtime_system();
+
+  if (!ret) {
+    gst_object_unref(pool);
+    caml_raise_constant(*caml_named_value("gstreamer_exn_failed"));
+  }
+
+  buffer_pool *bp = malloc(sizeof(buffer_pool));
+  if (bp == NULL) {
+    gst_buffer_pool_set_active(pool, FALSE);
+    gst_object_unref(pool);
+    caml_raise_out_of_memory();
+  }
+
+  bp->pool = pool;
+  bp->size = size;
+
+  ans = caml_alloc_custom(&buffer_pool_ops, sizeof(buffer_pool *), 0, 1);
+  Buffer_pool_val(ans) = bp;
+
+  CAMLreturn(ans);
+}
+
+/* Allocate a buffer of given length, from the given pool (an OCaml option) if
+ * there is one and the buffers it provides are large enough. This should be
+ * called with the OCaml runtime. */
+static GstBuffer *buffer_alloc(value _pool, int len) {
+  buffer_pool *bp = NULL;
+  GstBuffer *gstbuf = NULL;
+
+  if (Is_block(_pool))
+    bp = Buffer_pool_val(Field(_pool, 0));
+
+  caml_release_runtime_system();
+  if (bp && (guint)len <= bp->size) {
+    if (gst_buffer_pool_acquire_buffer(bp->pool, &gstbuf, NULL) == GST_FLOW_OK)
+      gst_buffer_set_size(gstbuf, len);
+    else
+      gstbuf = NULL;
+  }
+  if (!gstbuf)
+    gstbuf = gst_buffer_new_allocate(NULL, len, NULL);
+  caml_acquire_runtime_system();
+
+  return gstbuf;
+}
+
+CAMLprim value ocaml_gstreamer_appsrc_push_buffer_bytes_n(
+    value _as, value _pres_time, value _dur, value _pool, value _buf,
+    value _ofs, value _len) {
+  CAMLparam5(_as, _pres_time, _dur, _pool, _buf);
+  appsrc *as = Appsrc_val(_as);
+  GstBuffer *gstbuf;
+  GstFlowReturn ret;
+  int64_t pres_time = Int64_val(_pres_time);
+  int64_t dur = Int64_val(_dur);
+  unsigned char *data;
+
+  gstbuf = buffer_alloc(_pool, Int_val(_len));
+
+  if (!gstbuf)
+    caml_raise_out_of_memory();
+
+  if (pres_time >= 0)
+    gstbuf->pts = pres_time;
+
+  if (dur >= 0)
+    gstbuf->duration = dur;
+
+  data = Bytes_val(_buf);
+  buffer_fill(gstbuf, data, Int_val(_ofs), Int_val(_len));
+
+  caml_release_runtime_system();
+  ret = gst_app_src_push_buffer(as->appsrc, gstbuf);
+  caml_acquire_runtime_system();
+
+  if (ret != GST_FLOW_OK)
+    caml_raise_constant(*caml_named_value("gstreamer_exn_failed"));
+  CAMLreturn(Val_unit);
+}
+
+CAMLprim value ocaml_gstreamer_appsrc_push_buffer_bytes_b(value *argv,
+                                                          int argn) {
+  return ocaml_gstreamer_appsrc_push_buffer_bytes_n(
+      argv[0], argv[1], argv[2], argv[3], argv[4], argv[5], argv[6]);
+}
+
+CAMLprim value ocaml_gstreamer_appsrc_push_buffer(value _as, value _buf) {
+  CAMLparam2(_as, _buf);
+  appsrc *as = Appsrc_val(_as);
+  GstBuffer *gstbuf = Buffer_val(_buf);
+  GstFlowReturn ret;
+
+  /* gst_app_src_push_buffer takes ownership of the buffer. */
+  gst_buffer_ref(gstbuf);
+
+  caml_release_runtime_system();
+  ret = gst_app_src_push_buffer(as->appsrc, gstbuf);
+  caml_acquire_runtime_system();
+
+  if (ret != GST_FLOW_OK)
+    caml_raise_constant(*caml_named_value("gstreamer_exn_failed"));
+  CAMLreturn(Val_unit);
+}
+
+CAMLprim value ocaml_gstreamer_appsrc_push_buffer_list(value _as, value _bufs) {
+  CAMLparam2(_as, _bufs);
+  appsrc *as = Appsrc_val(_as);
+  int len = Wosize_val(_bufs);
+  GstBufferList *list;
+  GstFlowReturn ret;
+  int i;
+
+  list = gst_buffer_list_new_sized(len);
+  for (i = 0; i < len; i++)
+    gst_buffer_list_add(list, gst_buffer_ref(Buffer_val(Field(_bufs, i))));
+
+  caml_release_runtime_system();
+  ret = gst_app_src_push_buffer_list(as->appsrc, list);
+  caml_acquire_runtime_system();
+
+  if (ret != GST_FLOW_OK)
+    caml_raise_constant(*caml_named_value("gstreamer_exn_failed"));
+  CAMLreturn(Val_unit);
+}
+
+CAMLprim value ocaml_gstreamer_appsrc_push_buffer_data_n(
+    value _as, value _pres_time, value _dur, value _copy, value _pool,
+    value _buf, value _ofs, value _len) {
+  CAMLparam5(_as, _pres_time, _dur, _pool, _buf);
+  appsrc *as = Appsrc_val(_as);
+  GstBuffer *gstbuf;
+  GstFlowReturn ret;
+  int64_t pres_time = Int64_val(_pres_time);
+  int64_t dur = Int64_val(_dur);
+  char *data;
+
+  if (Bool_val(_copy)) {
+    gstbuf = buffer_alloc(_pool, Int_val(_len));
+
+    if (!gstbuf)
+      caml_raise_out_of_memory();
+
+    data = Caml_ba_data_val(_buf);
+    buffer_fill(gstbuf, data, Int_val(_ofs), Int_val(_len));
+  } else
+    gstbuf = buffer_of_data_wrapped(_buf, Int_val(_ofs), Int_val(_len));
+
+  if (pres_time >= 0)
+    gstbuf->pts = pres_time;
+
+  if (dur >= 0)
+    gstbuf->duration = dur;
+
+  caml_release_runtime_system();
+  ret = gst_app_src_push_buffer(as->appsrc, gstbuf);
+  caml_acquire_runtime_system();
+
+  if (ret != GST_FLOW_OK)
+    caml_raise_constant(*caml_named_value("gstreamer_exn_failed"));
+  CAMLreturn(Val_unit);
+}
+
+CAMLprim value ocaml_gstreamer_appsrc_push_buffer_data_b(value *argv,
+                                                         int argn) {
+  return ocaml_gstreamer_appsrc_push_buffer_data_n(argv[0], argv[1], argv[2],
+                                                   argv[3], argv[4], argv[5],
+                                                   argv[6], argv[7]);
+}
+
+static void appsrc_need_data_cb(GstAppSrc *gas, guint length,
+                                gpointer user_data) {
+  appsrc *as = (appsrc *)user_data;
+
+  ocaml_gstreamer_register_thread();
+  caml_acquire_runtime_system();
+  caml_callback(as->need_data_cb, Val_int(length));
+  caml_release_runtime_system();
+}
+
+CAMLprim value ocaml_gstreamer_appsrc_connect_need_data(value _as, value f) {
+  CAMLparam2(_as, f);
+  appsrc *as = Appsrc_val(_as);
+  disconnect_need_data(as);
+
+  as->need_data_cb = f;
+  caml_register_generational_global_root(&as->need_data_cb);
+
+  caml_release_runtime_system();
+  as->need_data_hid = g_signal_connect(as->appsrc, "need-data",
+                                       G_CALLBACK(appsrc_need_data_cb), as);
+  caml_acquire_runtime_system();
+
+  if (!as->need_data_hid)
+    caml_raise_constant(*caml_named_value("gstreamer_exn_failed"));
+  CAMLreturn(Val_unit);
+}
+
+CAMLprim value ocaml_gstreamer_appsrc_end_of_stream(value _as) {
+  CAMLparam1(_as);
+  appsrc *as = Appsrc_val(_as);
+  GstFlowReturn ret;
+
+  caml_release_runtime_system();
+  g_signal_emit_by_name(as->appsrc, "end-of-stream", &ret);
+  caml_acquire_runtime_system();
+
+  if (ret != GST_FLOW_OK)
+    caml_raise_constant(*caml_named_value("gstreamer_exn_failed"));
+  CAMLreturn(Val_unit);
+}
+
+CAMLprim value ocaml_gstreamer_appsrc_set_format(value _as, value _fmt) {
+  CAMLparam2(_as, _fmt);
+  appsrc *as = Appsrc_val(_as);
+  GstFormat fmt = format_val(_fmt);
+
+  caml_release_runtime_system();
+  g_object_set(G_OBJECT(as->appsrc), "format", fmt, NULL);
+  caml_acquire_runtime_system();
+
+  CAMLreturn(Val_unit);
+}
+
+CAMLprim value ocaml_gstreamer_appsrc_set_caps(value _as, value _caps) {
+  CAMLparam2(_as, _caps);
+  appsrc *as = Appsrc_val(_as);
+  GstCaps *caps = Caps_val(_caps);
+
+  caml_release_runtime_system();
+  gst_app_src_set_caps(as->appsrc, caps);
+  caml_acquire_runtime_system();
+
+  CAMLreturn(Val_unit);
+}
+
+/***** Appsink *****/
+
+typedef struct {
+  GstAppSink *appsink;
+  value element;
+  value new_sample_cb;   // Callback function
+  gulong new_sample_hid; // Callback handler ID
+  // Callbacks registered with gst_app_sink_set_callbacks
+  value callbacks_eos;
+  value callbacks_new_preroll;
+  value callbacks_new_sample;
+  gboolean callbacks_pull; // Whether samples are pulled for the callbacks
+  struct sample_ring *ring; // Ring filled by the streaming thread, if enabled
+  gboolean bridged; // Callbacks are owned by an app bridge
+  /* One reference for the OCaml handle, and one for each of the new-sample
+   * handler and the appsink callbacks, which may still be running on a
+   * streaming thread when the handle is finalized. */
+  gint refs;
+} appsink;
+
+/* A bounded single-producer single-consumer ring of samples. The producer is
+ * the streaming thread, which pulls samples from the appsink as long as there
+ * is room in the ring, and never needs the OCaml runtime. The consumer drains
+ * it from an OCaml thread. When the ring is full, samples are left in the
+ * appsink queue (bounded by max-buffers), and are pulled later on. */
+typedef struct sample_ring {
+  GstAppSink *appsink;
+  GstSample **samples;
+  guint size; // Always a power of two
+  gint head;  // Next slot to write, only modified by the producer
+  gint tail;  // Next slot to read, only modified by the consumer
+  gint refs;
+  /* Held while pulling from the appsink, so that samples are always pulled in
+   * order between the producer and the consumer. */
+  GMutex pull_mutex;
+  /* Held while draining, so that there is only one consumer at a time even
+   * when several OCaml threads drain the ring. */
+  GMutex drain_mutex;
+} sample_ring;
+
+static void sample_ring_unref(gpointer user_data) {
+  sample_ring *r = (sample_ring *)user_data;
+  guint i;
+
+  if (!g_atomic_int_dec_and_test(&r->refs))
+    return;
+
+  for (i = (guint)r->tail; i != (guint)r->head; i++)
+    gst_sample_unref(r->samples[i & (r->size - 1)]);
+
+  g_mutex_clear(&r->pull_mutex);
+  g_mutex_clear(&r->drain_mutex);
+  free(r->samples);
+  free(r);
+}
+
+static void sample_ring_fill(sample_ring *r) {
+  GstSample *gstsample;
+  guint head;
+
+  g_mutex_lock(&r->pull_mutex);
+  while (1) {
+    head = (guint)g_atomic_int_get(&r->head);
+    if (head - (guint)g_atomic_int_get(&r->tail) >= r->size)
+      break;
+    gstsample = gst_app_sink_try_pull_sample(r->appsink, 0);
+    if (!gstsample)
+      break;
+    r->samples[head & (r->size - 1)] = gstsample;
+    g_atomic_int_set(&r->head, (gint)(head + 1));
+  }
+  g_mutex_unlock(&r->pull_mutex);
+}
+
+static int sample_ring_drain(sample_ring *r, GstSample **samples, int max) {
+  GstSample *gstsample;
+  guint tail;
+  int n = 0;
+
+  while (n < max) {
+    tail = (guint)g_atomic_int_get(&r->tail);
+    if ((guint)g_atomic_int_get(&r->head) != tail) {
+      samples[n++] = r->samples[tail & (r->size - 1)];
+      g_atomic_int_set(&r->tail, (gint)(tail + 1));
+      continue;
+    }
+
+    /* The ring is empty, take samples left in the appsink, unless the
+     * producer is currently pulling them. */
+    if (!g_mutex_trylock(&r->pull_mutex))
+      break;
+    if ((guint)g_atomic_int_get(&r->head) != tail) {
+      g_mutex_unlock(&r->pull_mutex);
+      continue;
+    }
+    gstsample = gst_app_sink_try_pull_sample(r->appsink, 0);
+    g_mutex_unlock(&r->pull_mutex);
+
+    if (!gstsample)
+      break;
+    samples[n++] = gstsample;
+  }
+
+  return n;
+}
+
+#define Appsink_val(v) (*(appsink **)Data_custom_val(v))
+
+/* Global roots are removed before the last reference is dropped, so that this
+ * can be called from any thread. */
+static void appsink_unref(gpointer user_data) {
+  appsink *as = (appsink *)user_data;
+
+  if (g_atomic_int_dec_and_test(&as->refs))
+    free(as);
+}
+
+static void appsink_closure_unref(gpointer user_data, GClosure *closure) {
+  appsink_unref(user_data);
+}
+
+static void disconnect_new_sample(appsink *as) {
+  if (as->new_sample_hid) {
+    g_signal_handler_disconnect(as->appsink, as->new_sample_hid);
+    as->new_sample_hid = 0;
+  }
+  if (as->new_sample_cb) {
+    caml_remove_generational_global_root(&as->new_sample_cb);
+    as->new_sample_cb = 0;
+  }
+}
+
+/* The handle whose callbacks, ring or bridge are installed on an appsink is
+ * recorded on the element, so that other handles never remove them. */
+#define appsink_owner_quark()                                                  \
+  g_quark_from_static_string("ocaml-gstreamer-appsink-owner")
 
-  CAMLreturn(Val_unit);
+static gboolean appsink_is_owner(appsink *as) {
+  return g_object_get_qdata(G_OBJECT(as->appsink), appsink_owner_quark()) ==
+         as;
 }
 
-/***** Appsrc *****/
+/* Pass NULL to record that there is no owner anymore. */
+static void appsink_set_owner(GstAppSink *sink, appsink *as) {
+  if (as)
+    g_atomic_int_inc(&as->refs);
+  g_object_set_qdata_full(G_OBJECT(sink), appsink_owner_quark(), as,
+                          as ? appsink_unref : NULL);
+}
 
-typedef struct {
-  GstAppSrc *appsrc;
-  value element;
-  value need_data_cb;   // Callback function
-  gulong need_data_hid; // Callback handler ID
-} appsrc;
+static void remove_callback(value *cb) {
+  if (*cb) {
+    caml_remove_generational_global_root(cb);
+    *cb = 0;
+  }
+}
 
-#define Appsrc_val(v) (*(appsrc **)Data_custom_val(v))
+static void clear_callbacks(appsink *as) {
+  GstAppSinkCallbacks callbacks;
 
-static void disconnect_need_data(appsrc *as) {
-  if (as->need_data_hid) {
-    g_signal_handler_disconnect(as->appsrc, as->need_data_hid);
-    as->need_data_hid = 0;
+  /* Callbacks installed by another handle are left untouched. */
+  if (appsink_is_owner(as)) {
+    memset(&callbacks, 0, sizeof(callbacks));
+    gst_app_sink_set_callbacks(as->appsink, &callbacks, NULL, NULL);
+    appsink_set_owner(as->appsink, NULL);
   }
-  if (as->need_data_cb) {
-    caml_remove_generational_global_root(&as->need_data_cb);
-    as->need_data_cb = 0;
+
+  remove_callback(&as->callbacks_eos);
+  remove_callback(&as->callbacks_new_preroll);
+  remove_callback(&as->callbacks_new_sample);
+  as->callbacks_pull = FALSE;
+  as->bridged = FALSE;
+
+  if (as->ring) {
+    sample_ring_unref(as->ring);
+    as->ring = NULL;
   }
 }
 
-static void finalize_appsrc(value v) {
-  appsrc *as = Appsrc_val(v);
-  disconnect_need_data(as);
+static void finalize_appsink(value v) {
+  appsink *as = Appsink_val(v);
+  disconnect_new_sample(as);
+  /* A bridge does not depend on this handle and should keep running. */
+  if (!as->bridged)
+    clear_callbacks(as);
   if (as->element) {
     caml_remove_generational_global_root(&as->element);
     as->element = 0;
   }
-  free(as);
+  appsink_unref(as);
 }
 
-static struct custom_operations appsrc_ops = {
-    "ocaml_gstreamer_appsrc", finalize_appsrc,
-    custom_compare_default,   custom_hash_default,
-    custom_serialize_default, custom_deserialize_default};
+static struct custom_operations appsink_ops = {
+    "ocaml_gstreamer_appsink", finalize_appsink,
+    custom_compare_default,    custom_hash_default,
+    custom_serialize_default,  custom_deserialize_default};
 
-CAMLprim value ocaml_gstreamer_appsrc_of_element(value _e) {
+CAMLprim value ocaml_gstreamer_appsink_of_element(value _e) {
   CAMLparam1(_e);
   CAMLlocal1(ans);
 
   GstElement *e = Element_val(_e);
+  appsink *as = malloc(sizeof(appsink));
 
-  appsrc *as = malloc(sizeof(appsrc));
   if (as == NULL)
     caml_raise_out_of_memory();
 
-  as->appsrc = GST_APP_SRC(e);
-  as->need_data_cb = 0;
-  as->need_data_hid = 0;
+  as->appsink = GST_APP_SINK(e);
   as->element = _e;
-  caml_register_global_root(&as->element);
+  as->new_sample_cb = 0;
+  as->new_sample_hid = 0;
+  as->callbacks_eos = 0;
+  as->callbacks_new_preroll = 0;
+  as->callbacks_new_sample = 0;
+  as->callbacks_pull = FALSE;
+  as->ring = NULL;
+  as->bridged = FALSE;
+  as->refs = 1;
+  as->element = _e;
+  caml_register_generational_global_root(&as->element);
 
-  ans = caml_alloc_custom(&appsrc_ops, sizeof(appsrc *), 0, 1);
-  Appsrc_val(ans) = as;
+  ans = caml_alloc_custom(&appsink_ops, sizeof(appsink *), 0, 1);
+  Appsink_val(ans) = as;
 
   CAMLreturn(ans);
 }
 
-CAMLprim value ocaml_gstreamer_appsrc_to_element(value _as) {
+CAMLprim value ocaml_gstreamer_appsink_emit_signals(value _as) {
+  CAMLparam0();
+  appsink *as = Appsink_val(_as);
+
+  caml_release_runtime_system();
+  gst_app_sink_set_emit_signals(as->appsink, TRUE);
+  caml_acquire_runtime_system();
+
+  CAMLreturn(Val_unit);
+}
+
+CAMLprim value ocaml_gstreamer_appsink_pull_buffer(value _as) {
   CAMLparam1(_as);
   CAMLlocal1(ans);
-  appsrc *as = Appsrc_val(_as);
-  GstElement *e = GST_ELEMENT(as->appsrc);
-  value_of_element(e, ans);
+  appsink *as = Appsink_val(_as);
+  GstSample *gstsample;
+  GstBuffer *gstbuf = NULL;
+  gboolean eos = FALSE;
+
+  caml_release_runtime_system();
+  gstsample = gst_app_sink_pull_sample(as->appsink);
+  if (gstsample) {
+    gstbuf = gst_sample_get_buffer(gstsample);
+    if (gstbuf)
+      gst_buffer_ref(gstbuf);
+    gst_sample_unref(gstsample);
+  } else
+    eos = gst_app_sink_is_eos(as->appsink);
+  caml_acquire_runtime_system();
+
+  if (!gstsample) {
+    if (eos)
+      caml_raise_constant(*caml_named_value("gstreamer_exn_eos"));
+    else
+      caml_raise_constant(*caml_named_value("gstreamer_exn_stopped"));
+  }
+
+  if (!gstbuf)
+    caml_raise_out_of_memory();
+
+  value_of_buffer(gstbuf, ans);
   CAMLreturn(ans);
 }
 
-CAMLprim value ocaml_gstreamer_appsrc_push_buffer_bytes_n(
-    value _as, value _pres_time, value _dur, value _buf, value _ofs,
-    value _len) {
-  CAMLparam4(_as, _pres_time, _dur, _buf);
-  appsrc *as = Appsrc_val(_as);
-  GstBuffer *gstbuf;
-  GstFlowReturn ret;
-  int64_t pres_time = Int64_val(_pres_time);
-  int64_t dur = Int64_val(_dur);
-  unsigned char *data;
+CAMLprim value ocaml_gstreamer_appsink_pull_sample(value _as) {
+  CAMLparam1(_as);
+  CAMLlocal1(ans);
+  appsink *as = Appsink_val(_as);
+  GstSample *gstsample;
+  gboolean eos = FALSE;
+
+  caml_release_runtime_system();
+  gstsample = gst_app_sink_pull_sample(as->appsink);
+  if (!gstsample)
+    eos = gst_app_sink_is_eos(as->appsink);
+  caml_acquire_runtime_system();
+
+  if (!gstsample) {
+    if (eos)
+      caml_raise_constant(*caml_named_value("gstreamer_exn_eos"));
+    else
+      caml_raise_constant(*caml_named_value("gstreamer_exn_stopped"));
+  }
+
+  value_of_sample(gstsample, ans);
+  CAMLreturn(ans);
+}
+
+CAMLprim value ocaml_gstreamer_appsink_try_pull_sample(value _as,
+                                                       value _timeout) {
+  CAMLparam2(_as, _timeout);
+  CAMLlocal2(ans, sample);
+  appsink *as = Appsink_val(_as);
+  GstClockTime timeout = (GstClockTime)Int64_val(_timeout);
+  GstSample *gstsample;
+  gboolean eos = FALSE;
+
+  caml_release_runtime_system();
+  gstsample = gst_app_sink_try_pull_sample(as->appsink, timeout);
+  if (!gstsample)
+    eos = gst_app_sink_is_eos(as->appsink);
+  caml_acquire_runtime_system();
+
+  if (!gstsample) {
+    if (eos)
+      caml_raise_constant(*caml_named_value("gstreamer_exn_eos"));
+    CAMLreturn(Val_int(0));
+  }
+
+  value_of_sample(gstsample, sample);
+  ans = caml_alloc_tuple(1);
+  Store_field(ans, 0, sample);
+
+  CAMLreturn(ans);
+}
+
+static value appsink_try_pull(appsink *as, GstClockTime timeout,
+                              gboolean preroll) {
+  CAMLparam0();
+  CAMLlocal2(ans, buf);
+  GstSample *gstsample;
+  GstBuffer *gstbuf = NULL;
+  gboolean eos = FALSE;
 
   caml_release_runtime_system();
-  gstbuf = gst_buffer_new_allocate(NULL, Int_val(_len), NULL);
+  if (preroll)
+    gstsample = gst_app_sink_try_pull_preroll(as->appsink, timeout);
+  else
+    gstsample = gst_app_sink_try_pull_sample(as->appsink, timeout);
+  if (gstsample) {
+    gstbuf = gst_sample_get_buffer(gstsample);
+    if (gstbuf)
+      gst_buffer_ref(gstbuf);
+    gst_sample_unref(gstsample);
+  } else
+    eos = gst_app_sink_is_eos(as->appsink);
   caml_acquire_runtime_system();
 
+  if (!gstsample) {
+    if (eos)
+      caml_raise_constant(*caml_named_value("gstreamer_exn_eos"));
+    CAMLreturn(Val_int(0));
+  }
+
   if (!gstbuf)
     caml_raise_out_of_memory();
 
-  if (pres_time >= 0)
-    gstbuf->pts = pres_time;
+  value_of_buffer(gstbuf, buf);
+  ans = caml_alloc_tuple(1);
+  Store_field(ans, 0, buf);
 
-  if (dur >= 0)
-    gstbuf->duration = dur;
+  CAMLreturn(ans);
+}
 
-  data = Bytes_val(_buf);
-  buffer_fill(gstbuf, data, Int_val(_ofs), Int_val(_len));
+CAMLprim value ocaml_gstreamer_appsink_try_pull_buffer(value _as,
+                                                       value _timeout) {
+  CAMLparam2(_as, _timeout);
+  CAMLreturn(appsink_try_pull(Appsink_val(_as),
+                              (GstClockTime)Int64_val(_timeout), FALSE));
+}
+
+CAMLprim value ocaml_gstreamer_appsink_try_pull_preroll(value _as,
+                                                        value _timeout) {
+  CAMLparam2(_as, _timeout);
+  CAMLreturn(appsink_try_pull(Appsink_val(_as),
+                              (GstClockTime)Int64_val(_timeout), TRUE));
+}
+
+CAMLprim value ocaml_gstreamer_appsink_pull_many(value _as, value _timeout,
+                                                 value _max) {
+  CAMLparam2(_as, _timeout);
+  CAMLlocal2(ans, buf);
+  appsink *as = Appsink_val(_as);
+  GstClockTime timeout = GST_CLOCK_TIME_NONE;
+  GstClockTime wait;
+  gint64 deadline = 0, now;
+  int max = Int_val(_max);
+  GstSample *gstsample;
+  GstBuffer **gstbufs;
+  gboolean eos = FALSE;
+  int i, n = 0;
+
+  if (Is_block(_timeout)) {
+    timeout = (GstClockTime)Int64_val(Field(_timeout, 0));
+    deadline = g_get_monotonic_time() + timeout / GST_USECOND;
+  }
+
+  if (max <= 0)
+    CAMLreturn(Atom(0));
 
+  gstbufs = malloc(max * sizeof(GstBuffer *));
+  if (gstbufs == NULL)
+    caml_raise_out_of_memory();
+
+  /* Wait for the first sample and then only take the ones which are already
+   * available. */
   caml_release_runtime_system();
-  ret = gst_app_src_push_buffer(as->appsrc, gstbuf);
+  while (n < max) {
+    /* Samples without buffers do not count, so only wait for what is left
+     * of the timeout. */
+    wait = 0;
+    if (n == 0 && timeout == GST_CLOCK_TIME_NONE)
+      wait = GST_CLOCK_TIME_NONE;
+    else if (n == 0) {
+      now = g_get_monotonic_time();
+      if (now < deadline)
+        wait = (GstClockTime)(deadline - now) * GST_USECOND;
+    }
+    gstsample = gst_app_sink_try_pull_sample(as->appsink, wait);
+    if (!gstsample)
+      break;
+    gstbufs[n] = gst_sample_get_buffer(gstsample);
+    if (gstbufs[n]) {
+      gst_buffer_ref(gstbufs[n]);
+      n++;
+    }
+    gst_sample_unref(gstsample);
+  }
+  if (n == 0)
+    eos = gst_app_sink_is_eos(as->appsink);
   caml_acquire_runtime_system();
 
-  if (ret != GST_FLOW_OK)
-    caml_raise_constant(*caml_named_value("gstreamer_exn_failed"));
-  CAMLreturn(Val_unit);
+  if (n == 0 && (eos || !Is_block(_timeout))) {
+    free(gstbufs);
+    if (eos)
+      caml_raise_constant(*caml_named_value("gstreamer_exn_eos"));
+    else
+      caml_raise_constant(*caml_named_value("gstreamer_exn_stopped"));
+  }
+
+  ans = caml_alloc_tuple(n);
+  for (i = 0; i < n; i++) {
+    value_of_buffer(gstbufs[i], buf);
+    Store_field(ans, i, buf);
+  }
+  free(gstbufs);
+
+  CAMLreturn(ans);
 }
 
-CAMLprim value ocaml_gstreamer_appsrc_push_buffer_bytes_b(value *argv,
-                                                          int argn) {
-  return ocaml_gstreamer_appsrc_push_buffer_bytes_n(argv[0], argv[1], argv[2],
-                                                    argv[3], argv[4], argv[5]);
+CAMLprim value ocaml_gstreamer_appsink_is_eos(value _as) {
+  CAMLparam1(_as);
+  appsink *as = Appsink_val(_as);
+  gboolean ret;
+
+  caml_release_runtime_system();
+  ret = gst_app_sink_is_eos(as->appsink);
+  caml_acquire_runtime_system();
+
+  CAMLreturn(Val_bool(ret));
 }
 
-CAMLprim value ocaml_gstreamer_appsrc_push_buffer(value _as, value _buf) {
-  CAMLparam2(_as, _buf);
-  appsrc *as = Appsrc_val(_as);
-  GstBuffer *gstbuf = Buffer_val(_buf);
-  GstFlowReturn ret;
+static GstFlowReturn appsink_new_sample_cb(GstAppSink *gas,
+                                           gpointer user_data) {
+  appsink *as = (appsink *)user_data;
+
+  ocaml_gstreamer_register_thread();
+  caml_acquire_runtime_system();
+  /* The handler might have been disconnected in the meantime. */
+  if (as->new_sample_cb)
+    caml_callback(as->new_sample_cb, Val_unit);
+  caml_release_runtime_system();
+
+  return GST_FLOW_OK;
+}
+
+CAMLprim value ocaml_gstreamer_appsink_connect_new_sample(value _as, value f) {
+  CAMLparam2(_as, f);
+  appsink *as = Appsink_val(_as);
+  disconnect_new_sample(as);
+
+  as->new_sample_cb = f;
+  caml_register_generational_global_root(&as->new_sample_cb);
 
+  g_atomic_int_inc(&as->refs);
   caml_release_runtime_system();
-  g_signal_emit_by_name(GST_ELEMENT(as->appsrc), "push-buffer", gstbuf, &ret);
+  as->new_sample_hid = g_signal_connect_data(
+      as->appsink, "new-sample", G_CALLBACK(appsink_new_sample_cb), as,
+      appsink_closure_unref, 0);
   caml_acquire_runtime_system();
 
-  if (ret != GST_FLOW_OK)
+  if (!as->new_sample_hid) {
+    appsink_unref(as);
     caml_raise_constant(*caml_named_value("gstreamer_exn_failed"));
+  }
   CAMLreturn(Val_unit);
 }
 
-CAMLprim value ocaml_gstreamer_appsrc_push_buffer_data_n(value _as,
-                                                         value _pres_time,
-                                                         value _dur, value _buf,
-                                                         value _ofs,
-                                                         value _len) {
-  CAMLparam4(_as, _pres_time, _dur, _buf);
-  appsrc *as = Appsrc_val(_as);
-  GstBuffer *gstbuf;
-  GstFlowReturn ret;
-  int64_t pres_time = Int64_val(_pres_time);
-  int64_t dur = Int64_val(_dur);
-  char *data;
+/* Error describing an exception raised by a callback. This should be called
+ * with the OCaml runtime. */
+static GError *appsink_callback_error(value ret) {
+  char *exn = caml_format_exception(Extract_exception(ret));
+  GError *err = g_error_new(GST_LIBRARY_ERROR, GST_LIBRARY_ERROR_FAILED,
+                            "Exception raised by appsink callback: %s", exn);
+  caml_stat_free(exn);
+  return err;
+}
+
+/* This should be called without the OCaml runtime, since sync handlers of the
+ * bus might need it. */
+static void appsink_post_error(GstAppSink *gas, GError *err) {
+  gst_element_post_message(GST_ELEMENT(gas),
+                           gst_message_new_error(GST_OBJECT(gas), err, NULL));
+  g_error_free(err);
+}
+
+static void appsink_callbacks_eos_cb(GstAppSink *gas, gpointer user_data) {
+  appsink *as = (appsink *)user_data;
+  value ret = Val_unit;
+  GError *err = NULL;
+
+  ocaml_gstreamer_register_thread();
+  caml_acquire_runtime_system();
+  /* Callbacks might have been removed in the meantime. */
+  if (as->callbacks_eos)
+    ret = caml_callback_exn(as->callbacks_eos, Val_unit);
+  if (Is_exception_result(ret))
+    err = appsink_callback_error(ret);
+  caml_release_runtime_system();
+
+  if (err)
+    appsink_post_error(gas, err);
+}
+
+static GstFlowReturn appsink_callbacks_sample(appsink *as, gboolean preroll) {
+  GstSample *gstsample;
+  GstBuffer *gstbuf = NULL;
+  value ret = Val_unit;
+  value arg = Val_unit;
+  value cb;
+  GError *err = NULL;
+
+  if (as->callbacks_pull) {
+    if (preroll)
+      gstsample = gst_app_sink_pull_preroll(as->appsink);
+    else
+      gstsample = gst_app_sink_pull_sample(as->appsink);
+
+    if (!gstsample)
+      return GST_FLOW_OK;
+
+    gstbuf = gst_sample_get_buffer(gstsample);
+    if (gstbuf)
+      gst_buffer_ref(gstbuf);
+    gst_sample_unref(gstsample);
+
+    if (!gstbuf)
+      return GST_FLOW_OK;
+  }
+
+  ocaml_gstreamer_register_thread();
+  caml_acquire_runtime_system();
+  if (gstbuf) {
+    value_of_buffer(gstbuf, arg);
+  }
+  /* Read after allocating since the callback might be moved by the GC. */
+  cb = preroll ? as->callbacks_new_preroll : as->callbacks_new_sample;
+  if (cb)
+    ret = caml_callback_exn(cb, arg);
+  if (Is_exception_result(ret))
+    err = appsink_callback_error(ret);
+  caml_release_runtime_system();
+
+  if (err) {
+    appsink_post_error(as->appsink, err);
+    return GST_FLOW_ERROR;
+  }
+  return GST_FLOW_OK;
+}
+
+static GstFlowReturn appsink_callbacks_new_preroll_cb(GstAppSink *gas,
+                                                      gpointer user_data) {
+  return appsink_callbacks_sample((appsink *)user_data, TRUE);
+}
+
+static GstFlowReturn appsink_callbacks_new_sample_cb(GstAppSink *gas,
+                                                     gpointer user_data) {
+  return appsink_callbacks_sample((appsink *)user_data, FALSE);
+}
+
+CAMLprim value ocaml_gstreamer_appsink_set_callbacks(value _as, value _pull,
+                                                     value _eos,
+                                                     value _new_preroll,
+                                                     value _new_sample) {
+  CAMLparam5(_as, _pull, _eos, _new_preroll, _new_sample);
+  appsink *as = Appsink_val(_as);
+  GstAppSinkCallbacks callbacks;
+
+  clear_callbacks(as);
+  memset(&callbacks, 0, sizeof(callbacks));
+  as->callbacks_pull = Bool_val(_pull);
+
+  if (Is_block(_eos)) {
+    as->callbacks_eos = Field(_eos, 0);
+    caml_register_generational_global_root(&as->callbacks_eos);
+    callbacks.eos = appsink_callbacks_eos_cb;
+  }
+
+  if (Is_block(_new_preroll)) {
+    as->callbacks_new_preroll = Field(_new_preroll, 0);
+    caml_register_generational_global_root(&as->callbacks_new_preroll);
+    callbacks.new_preroll = appsink_callbacks_new_preroll_cb;
+  }
+
+  if (Is_block(_new_sample)) {
+    as->callbacks_new_sample = Field(_new_sample, 0);
+    caml_register_generational_global_root(&as->callbacks_new_sample);
+    callbacks.new_sample = appsink_callbacks_new_sample_cb;
+  }
 
+  g_atomic_int_inc(&as->refs);
   caml_release_runtime_system();
-  gstbuf = gst_buffer_new_allocate(NULL, Int_val(_len), NULL);
+  gst_app_sink_set_callbacks(as->appsink, &callbacks, as, appsink_unref);
   caml_acquire_runtime_system();
+  appsink_set_owner(as->appsink, as);
 
-  if (!gstbuf)
+  CAMLreturn(Val_unit);
+}
+
+static GstFlowReturn appsink_ring_new_sample_cb(GstAppSink *gas,
+                                                gpointer user_data) {
+  sample_ring_fill((sample_ring *)user_data);
+  return GST_FLOW_OK;
+}
+
+CAMLprim value ocaml_gstreamer_appsink_enable_ring(value _as, value _size) {
+  CAMLparam1(_as);
+  appsink *as = Appsink_val(_as);
+  GstAppSinkCallbacks callbacks;
+  sample_ring *r;
+  intnat n = Int_val(_size);
+  guint size = 1;
+
+  /* Make sure that rounding up to a power of two and computing the size of
+   * the allocation do not overflow. */
+  if (n < 1 || n > G_MAXINT / 2 ||
+      (gsize)n > G_MAXSIZE / (2 * sizeof(GstSample *)))
+    caml_invalid_argument("App_sink.enable_ring: size");
+
+  while (size < (guint)n)
+    size <<= 1;
+
+  r = malloc(sizeof(sample_ring));
+  if (r == NULL)
     caml_raise_out_of_memory();
 
-  if (pres_time >= 0)
-    gstbuf->pts = pres_time;
+  r->samples = malloc(size * sizeof(GstSample *));
+  if (r->samples == NULL) {
+    free(r);
+    caml_raise_out_of_memory();
+  }
 
-  if (dur >= 0)
-    gstbuf->duration = dur;
+  r->appsink = as->appsink;
+  r->size = size;
+  r->head = 0;
+  r->tail = 0;
+  /* One reference for the appsink callbacks and one for us. */
+  r->refs = 2;
+  g_mutex_init(&r->pull_mutex);
+  g_mutex_init(&r->drain_mutex);
 
-  data = Caml_ba_data_val(_buf);
-  buffer_fill(gstbuf, data, Int_val(_ofs), Int_val(_len));
+  clear_callbacks(as);
+  as->ring = r;
+
+  memset(&callbacks, 0, sizeof(callbacks));
+  callbacks.new_sample = appsink_ring_new_sample_cb;
 
   caml_release_runtime_system();
-  ret = gst_app_src_push_buffer(as->appsrc, gstbuf);
+  gst_app_sink_set_callbacks(as->appsink, &callbacks, r, sample_ring_unref);
   caml_acquire_runtime_system();
+  appsink_set_owner(as->appsink, as);
 
-  if (ret != GST_FLOW_OK)
-    caml_raise_constant(*caml_named_value("gstreamer_exn_failed"));
   CAMLreturn(Val_unit);
 }
 
-CAMLprim value ocaml_gstreamer_appsrc_push_buffer_data_b(value *argv,
-                                                         int argn) {
-  return ocaml_gstreamer_appsrc_push_buffer_data_n(argv[0], argv[1], argv[2],
-                                                   argv[3], argv[4], argv[5]);
-}
+CAMLprim value ocaml_gstreamer_appsink_drain_ring(value _as, value _max) {
+  CAMLparam1(_as);
+  CAMLlocal2(ans, buf);
+  appsink *as = Appsink_val(_as);
+  sample_ring *r = as->ring;
+  int max = Int_val(_max);
+  GstSample **samples;
+  GstBuffer **gstbufs;
+  int i, n, len = 0;
 
-static void appsrc_need_data_cb(GstAppSrc *gas, guint length,
-                                gpointer user_data) {
-  appsrc *as = (appsrc *)user_data;
+  if (!r)
+    caml_raise_constant(*caml_named_value("gstreamer_exn_failed"));
+
+  if (max <= 0)
+    CAMLreturn(Atom(0));
+
+  if ((gsize)max > G_MAXSIZE / sizeof(GstSample *))
+    caml_invalid_argument("App_sink.drain_ring: size");
+
+  samples = malloc(max * sizeof(GstSample *));
+  gstbufs = malloc(max * sizeof(GstBuffer *));
+  if (samples == NULL || gstbufs == NULL) {
+    free(samples);
+    free(gstbufs);
+    caml_raise_out_of_memory();
+  }
+
+  g_atomic_int_inc(&r->refs);
 
-  ocaml_gstreamer_register_thread();
-  caml_acquire_runtime_system();
-  caml_callback(as->need_data_cb, Val_int(length));
   caml_release_runtime_system();
-}
+  g_mutex_lock(&r->drain_mutex);
+  n = sample_ring_drain(r, samples, max);
+  g_mutex_unlock(&r->drain_mutex);
+  sample_ring_unref(r);
+  for (i = 0; i < n; i++) {
+    gstbufs[len] = gst_sample_get_buffer(samples[i]);
+    if (gstbufs[len]) {
+      gst_buffer_ref(gstbufs[len]);
+      len++;
+    }
+    gst_sample_unref(samples[i]);
+  }
+  caml_acquire_runtime_system();
 
-CAMLprim value ocaml_gstreamer_appsrc_connect_need_data(value _as, value f) {
-  CAMLparam2(_as, f);
-  appsrc *as = Appsrc_val(_as);
-  disconnect_need_data(as);
+  free(samples);
 
-  as->need_data_cb = f;
-  caml_register_generational_global_root(&as->need_data_cb);
+  ans = caml_alloc_tuple(len);
+  for (i = 0; i < len; i++) {
+    value_of_buffer(gstbufs[i], buf);
+    Store_field(ans, i, buf);
+  }
+  free(gstbufs);
+
+  CAMLreturn(ans);
+}
+
+CAMLprim value ocaml_gstreamer_appsink_set_max_buffers(value _as, value _n) {
+  CAMLparam2(_as, _n);
+  appsink *as = Appsink_val(_as);
+  int n = Int_val(_n);
 
   caml_release_runtime_system();
-  as->need_data_hid = g_signal_connect(as->appsrc, "need-data",
-                                       G_CALLBACK(appsrc_need_data_cb), as);
+  gst_app_sink_set_max_buffers(as->appsink, n);
   caml_acquire_runtime_system();
 
-  if (!as->need_data_hid)
-    caml_raise_constant(*caml_named_value("gstreamer_exn_failed"));
   CAMLreturn(Val_unit);
 }
 
-CAMLprim value ocaml_gstreamer_appsrc_end_of_stream(value _as) {
-  CAMLparam1(_as);
-  appsrc *as = Appsrc_val(_as);
-  GstFlowReturn ret;
+CAMLprim value ocaml_gstreamer_appsink_set_caps(value _as, value _caps) {
+  CAMLparam2(_as, _caps);
+  appsink *as = Appsink_val(_as);
+  GstCaps *caps = Caps_val(_caps);
 
   caml_release_runtime_system();
-  g_signal_emit_by_name(as->appsrc, "end-of-stream", &ret);
+  gst_app_sink_set_caps(as->appsink, caps);
   caml_acquire_runtime_system();
 
-  if (ret != GST_FLOW_OK)
-    caml_raise_constant(*caml_named_value("gstreamer_exn_failed"));
   CAMLreturn(Val_unit);
 }
 
-CAMLprim value ocaml_gstreamer_appsrc_set_format(value _as, value _fmt) {
-  CAMLparam2(_as, _fmt);
-  appsrc *as = Appsrc_val(_as);
-  GstFormat fmt = format_val(_fmt);
+CAMLprim value ocaml_gstreamer_appsink_get_caps(value _as) {
+  CAMLparam1(_as);
+  appsink *as = Appsink_val(_as);
+  GstCaps *caps;
 
   caml_release_runtime_system();
-  g_object_set(G_OBJECT(as->appsrc), "format", fmt, NULL);
+  caps = gst_app_sink_get_caps(as->appsink);
   caml_acquire_runtime_system();
 
-  CAMLreturn(Val_unit);
+  if (!caps)
+    caml_raise_not_found();
+
+  CAMLreturn(value_of_caps(caps));
 }
 
-/***** Appsink *****/
+/***** App bridge *****/
 
+/* Forwards samples from an appsink to an appsrc on the streaming thread of the
+ * appsink. The bridge is shared between the appsink callbacks (until they are
+ * replaced) and OCaml (until the handle is finalized). */
 typedef struct {
+  appsink *as; // Handle which was bridged
   GstAppSink *appsink;
-  value element;
-  value new_sample_cb;   // Callback function
-  gulong new_sample_hid; // Callback handler ID
-} appsink;
+  GstAppSrc *appsrc;
+  gint refs;
+  gint active; // Whether the appsink callbacks are still ours
+  GMutex lock; // Protects the fields below
+  guint64 buffers;
+  guint64 bytes;
+  guint64 inspected;
+  ocaml_root *inspect; // Called on every inspect_every buffer, if any
+  guint inspect_every;
+} app_bridge;
+
+#define App_bridge_val(v) (*(app_bridge **)Data_custom_val(v))
+
+static void app_bridge_unref(gpointer user_data) {
+  app_bridge *b = (app_bridge *)user_data;
+
+  if (!g_atomic_int_dec_and_test(&b->refs))
+    return;
+
+  if (b->inspect)
+    ocaml_root_release(b->inspect);
+  appsink_unref(b->as);
+  gst_object_unref(b->appsink);
+  gst_object_unref(b->appsrc);
+  g_mutex_clear(&b->lock);
+  free(b);
+}
 
-#define Appsink_val(v) (*(appsink **)Data_custom_val(v))
+static void app_bridge_callbacks_destroyed(gpointer user_data) {
+  app_bridge *b = (app_bridge *)user_data;
 
-static void disconnect_new_sample(appsink *as) {
-  if (as->new_sample_hid) {
-    g_signal_handler_disconnect(as->appsink, as->new_sample_hid);
-    as->new_sample_hid = 0;
+  g_atomic_int_set(&b->active, 0);
+  app_bridge_unref(b);
+}
+
+static void finalize_app_bridge(value v) {
+  app_bridge_unref(App_bridge_val(v));
+}
+
+static struct custom_operations app_bridge_ops = {
+    "ocaml_gstreamer_app_bridge", finalize_app_bridge,
+    custom_compare_default,       custom_hash_default,
+    custom_serialize_default,     custom_deserialize_default};
+
+static value app_bridge_inspect(ocaml_root *cb, GstBuffer *gstbuf) {
+  CAMLparam0();
+  CAMLlocal1(buf);
+
+  value_of_buffer(gstbuf, buf);
+
+  CAMLreturn(caml_callback_exn(cb->v, buf));
+}
+
+static GstFlowReturn app_bridge_new_sample_cb(GstAppSink *gas,
+                                              gpointer user_data) {
+  app_bridge *b = (app_bridge *)user_data;
+  GstSample *gstsample;
+  GstBuffer *gstbuf;
+  GstFlowReturn ret;
+  gboolean inspect = FALSE;
+  value exn = Val_unit;
+
+  gstsample = gst_app_sink_pull_sample(gas);
+  if (!gstsample)
+    return GST_FLOW_OK;
+
+  gstbuf = gst_sample_get_buffer(gstsample);
+  if (gstbuf) {
+    g_mutex_lock(&b->lock);
+    b->buffers++;
+    b->bytes += gst_buffer_get_size(gstbuf);
+    if (b->inspect && b->buffers % b->inspect_every == 0) {
+      b->inspected++;
+      inspect = TRUE;
+    }
+    g_mutex_unlock(&b->lock);
   }
-  if (as->new_sample_cb) {
-    caml_remove_generational_global_root(&as->new_sample_cb);
-    as->new_sample_cb = 0;
+
+  if (inspect) {
+    gst_buffer_ref(gstbuf);
+    ocaml_gstreamer_register_thread();
+    caml_acquire_runtime_system();
+    exn = app_bridge_inspect(b->inspect, gstbuf);
+    caml_release_runtime_system();
   }
-}
 
-static void finalize_appsink(value v) {
-  appsink *as = Appsink_val(v);
-  disconnect_new_sample(as);
-  if (as->element) {
-    caml_remove_generational_global_root(&as->element);
-    as->element = 0;
+  /* Stop the stream when the inspection function raised an exception. */
+  if (Is_exception_result(exn)) {
+    gst_sample_unref(gstsample);
+    return GST_FLOW_ERROR;
   }
-  free(as);
+
+  /* This refs the buffer and updates the caps of the appsrc if needed. */
+  ret = gst_app_src_push_sample(b->appsrc, gstsample);
+  gst_sample_unref(gstsample);
+
+  return ret;
 }
 
-static struct custom_operations appsink_ops = {
-    "ocaml_gstreamer_appsink", finalize_appsink,
-    custom_compare_default,    custom_hash_default,
-    custom_serialize_default,  custom_deserialize_default};
+static void app_bridge_eos_cb(GstAppSink *gas, gpointer user_data) {
+  app_bridge *b = (app_bridge *)user_data;
+  gst_app_src_end_of_stream(b->appsrc);
+}
 
-CAMLprim value ocaml_gstreamer_appsink_of_element(value _e) {
-  CAMLparam1(_e);
+CAMLprim value ocaml_gstreamer_app_bridge_connect(value _sink, value _src,
+                                                  value _inspect,
+                                                  value _every) {
+  CAMLparam4(_sink, _src, _inspect, _every);
   CAMLlocal1(ans);
+  appsink *as = Appsink_val(_sink);
+  intnat every = Long_val(_every);
+  GstAppSinkCallbacks callbacks;
+  app_bridge *b;
 
-  GstElement *e = Element_val(_e);
-  appsink *as = malloc(sizeof(appsink));
+  if (every <= 0 || (guint64)every > G_MAXUINT)
+    caml_invalid_argument("App_bridge.connect: inspect_every");
 
-  if (as == NULL)
+  b = malloc(sizeof(app_bridge));
+  if (b == NULL)
     caml_raise_out_of_memory();
 
-  as->appsink = GST_APP_SINK(e);
-  as->element = _e;
-  as->new_sample_cb = 0;
-  as->new_sample_hid = 0;
-  as->element = _e;
-  caml_register_generational_global_root(&as->element);
+  b->as = as;
+  g_atomic_int_inc(&as->refs);
+  b->appsink = gst_object_ref(as->appsink);
+  b->appsrc = gst_object_ref(Appsrc_val(_src)->appsrc);
+  /* One reference for the appsink callbacks and one for OCaml. */
+  b->refs = 2;
+  b->active = 1;
+  g_mutex_init(&b->lock);
+  b->buffers = 0;
+  b->bytes = 0;
+  b->inspected = 0;
+  b->inspect = NULL;
+  b->inspect_every = every;
+  if (Is_block(_inspect)) {
+    ocaml_roots_collect();
+    b->inspect = ocaml_root_create(Field(_inspect, 0));
+  }
 
-  ans = caml_alloc_custom(&appsink_ops, sizeof(appsink *), 0, 1);
-  Appsink_val(ans) = as;
+  ans = caml_alloc_custom(&app_bridge_ops, sizeof(app_bridge *), 0, 1);
+  App_bridge_val(ans) = b;
+
+  clear_callbacks(as);
+  as->bridged = TRUE;
+
+  memset(&callbacks, 0, sizeof(callbacks));
+  callbacks.eos = app_bridge_eos_cb;
+  callbacks.new_sample = app_bridge_new_sample_cb;
+
+  caml_release_runtime_system();
+  gst_app_sink_set_callbacks(b->appsink, &callbacks, b,
+                             app_bridge_callbacks_destroyed);
+  caml_acquire_runtime_system();
+  appsink_set_owner(b->appsink, as);
 
   CAMLreturn(ans);
 }
 
-CAMLprim value ocaml_gstreamer_appsink_emit_signals(value _as) {
-  CAMLparam0();
-  appsink *as = Appsink_val(_as);
+CAMLprim value ocaml_gstreamer_app_bridge_disconnect(value _b) {
+  CAMLparam1(_b);
+  app_bridge *b = App_bridge_val(_b);
+  GstAppSinkCallbacks callbacks;
+
+  if (!g_atomic_int_get(&b->active))
+    CAMLreturn(Val_unit);
+
+  /* The callbacks of the sink are ours, so its handle is still bridged. */
+  b->as->bridged = FALSE;
+  memset(&callbacks, 0, sizeof(callbacks));
 
   caml_release_runtime_system();
-  gst_app_sink_set_emit_signals(as->appsink, TRUE);
+  gst_app_sink_set_callbacks(b->appsink, &callbacks, NULL, NULL);
   caml_acquire_runtime_system();
+  if (appsink_is_owner(b->as))
+    appsink_set_owner(b->appsink, NULL);
 
   CAMLreturn(Val_unit);
 }
 
-CAMLprim value ocaml_gstreamer_appsink_pull_buffer(value _as) {
-  CAMLparam1(_as);
+CAMLprim value ocaml_gstreamer_app_bridge_stats(value _b) {
+  CAMLparam1(_b);
   CAMLlocal1(ans);
-  appsink *as = Appsink_val(_as);
-  GstSample *gstsample;
-  GstBuffer *gstbuf;
+  app_bridge *b = App_bridge_val(_b);
+  guint64 buffers, bytes, inspected;
 
-  caml_release_runtime_system();
-  gstsample = gst_app_sink_pull_sample(as->appsink);
-  caml_acquire_runtime_system();
+  g_mutex_lock(&b->lock);
+  buffers = b->buffers;
+  bytes = b->bytes;
+  inspected = b->inspected;
+  g_mutex_unlock(&b->lock);
 
-  if (!gstsample) {
-    if (gst_app_sink_is_eos(as->appsink))
-      caml_raise_constant(*caml_named_value("gstreamer_exn_eos"));
-    else
-      caml_raise_constant(*caml_named_value("gstreamer_exn_stopped"));
-  }
+  ans = caml_alloc_tuple(3);
+  Store_field(ans, 0, Val_long(buffers));
+  Store_field(ans, 1, Val_long(bytes));
+  Store_field(ans, 2, Val_long(inspected));
 
-  caml_release_runtime_system();
-  gstbuf = gst_sample_get_buffer(gstsample);
-  caml_acquire_runtime_system();
+  CAMLreturn(ans);
+}
 
-  if (!gstbuf)
-    caml_raise_out_of_memory();
+/***** DSP *****/
 
-  gst_buffer_ref(gstbuf);
-  gst_sample_unref(gstsample);
+/* The loops below are written so that compilers can vectorize them: no
+ * aliasing between inputs and outputs, and no branches in the loop bodies.
+ * There are no explicit intrinsics: config/discover enables the vectorizer
+ * when the compiler supports it. */
 
-  value_of_buffer(gstbuf, ans);
-  CAMLreturn(ans);
+/* Check that len elements of elt_size bytes fit in a bigarray after an offset
+ * counted in units of ofs_size bytes, without any overflowing
+ * multiplication. */
+static void dsp_check(value ba, intnat ofs, intnat ofs_size, intnat len,
+                      intnat elt_size) {
+  intnat size = caml_ba_byte_size(Caml_ba_array_val(ba));
+
+  if (ofs < 0 || len < 0 || ofs > size / ofs_size ||
+      len > (size - ofs * ofs_size) / elt_size)
+    caml_invalid_argument("index out of bounds");
 }
 
-CAMLprim value ocaml_gstreamer_appsink_is_eos(value _as) {
-  CAMLparam1(_as);
-  appsink *as = Appsink_val(_as);
-  gboolean ret;
+/* Number of samples of len frames of chans channels. */
+static intnat dsp_frames(intnat len, int chans) {
+  if (len < 0 || (chans > 0 && len > Max_long / chans))
+    caml_invalid_argument("index out of bounds");
+  return len * chans;
+}
+
+CAMLprim value ocaml_gstreamer_dsp_of_s16le(value _src, value _sofs,
+                                            value _dst, value _dofs,
+                                            value _len) {
+  CAMLparam2(_src, _dst);
+  intnat sofs = Long_val(_sofs);
+  intnat dofs = Long_val(_dofs);
+  intnat len = Long_val(_len);
+  const guint8 *restrict src;
+  float *restrict dst;
+  intnat i;
+
+  dsp_check(_src, sofs, 1, len, 2);
+  dsp_check(_dst, dofs, sizeof(float), len, sizeof(float));
+  src = (const guint8 *)Caml_ba_data_val(_src) + sofs;
+  dst = (float *)Caml_ba_data_val(_dst) + dofs;
 
   caml_release_runtime_system();
-  ret = gst_app_sink_is_eos(as->appsink);
+  for (i = 0; i < len; i++)
+    dst[i] = (gint16)(src[2 * i] | (src[2 * i + 1] << 8)) * (1.f / 32768.f);
   caml_acquire_runtime_system();
 
-  CAMLreturn(Val_bool(ret));
+  CAMLreturn(Val_unit);
 }
 
-static GstFlowReturn appsink_new_sample_cb(GstAppSink *gas,
-                                           gpointer user_data) {
-  appsink *as = (appsink *)user_data;
+CAMLprim value ocaml_gstreamer_dsp_to_s16le(value _src, value _sofs,
+                                            value _dst, value _dofs,
+                                            value _len) {
+  CAMLparam2(_src, _dst);
+  intnat sofs = Long_val(_sofs);
+  intnat dofs = Long_val(_dofs);
+  intnat len = Long_val(_len);
+  const float *restrict src;
+  guint8 *restrict dst;
+  gint16 x;
+  float f;
+  intnat i;
+
+  dsp_check(_src, sofs, sizeof(float), len, sizeof(float));
+  dsp_check(_dst, dofs, 1, len, 2);
+  src = (const float *)Caml_ba_data_val(_src) + sofs;
+  dst = (guint8 *)Caml_ba_data_val(_dst) + dofs;
 
-  ocaml_gstreamer_register_thread();
-  caml_acquire_runtime_system();
-  caml_callback(as->new_sample_cb, Val_unit);
   caml_release_runtime_system();
+  for (i = 0; i < len; i++) {
+    f = src[i] * 32768.f;
+    f = f < -32768.f ? -32768.f : f;
+    f = f > 32767.f ? 32767.f : f;
+    x = (gint16)f;
+    dst[2 * i] = x & 0xff;
+    dst[2 * i + 1] = (x >> 8) & 0xff;
+  }
+  caml_acquire_runtime_system();
 
-  return GST_FLOW_OK;
+  CAMLreturn(Val_unit);
 }
 
-CAMLprim value ocaml_gstreamer_appsink_connect_new_sample(value _as, value f) {
-  CAMLparam2(_as, f);
-  appsink *as = Appsink_val(_as);
-  disconnect_new_sample(as);
+CAMLprim value ocaml_gstreamer_dsp_gain(value _buf, value _ofs, value _len,
+                                        value _gain) {
+  CAMLparam1(_buf);
+  intnat ofs = Long_val(_ofs);
+  intnat len = Long_val(_len);
+  float gain = Double_val(_gain);
+  float *buf;
+  intnat i;
 
-  as->new_sample_cb = f;
-  caml_register_generational_global_root(&as->new_sample_cb);
+  dsp_check(_buf, ofs, sizeof(float), len, sizeof(float));
+  buf = (float *)Caml_ba_data_val(_buf) + ofs;
 
   caml_release_runtime_system();
-  as->new_sample_hid = g_signal_connect(as->appsink, "new-sample",
-                                        G_CALLBACK(appsink_new_sample_cb), as);
+  for (i = 0; i < len; i++)
+    buf[i] *= gain;
   caml_acquire_runtime_system();
 
-  if (!as->new_sample_hid)
-    caml_raise_constant(*caml_named_value("gstreamer_exn_failed"));
   CAMLreturn(Val_unit);
 }
 
-CAMLprim value ocaml_gstreamer_appsink_set_max_buffers(value _as, value _n) {
-  CAMLparam2(_as, _n);
-  appsink *as = Appsink_val(_as);
-  int n = Int_val(_n);
+/* Retrieve the data of an array of float bigarrays with at least len
+ * elements. */
+static float **dsp_buffers(value _bufs, intnat len) {
+  int n = Wosize_val(_bufs);
+  float **bufs;
+  int i;
+
+  for (i = 0; i < n; i++)
+    dsp_check(Field(_bufs, i), 0, sizeof(float), len, sizeof(float));
+
+  bufs = malloc(n * sizeof(float *));
+  if (n && !bufs)
+    caml_raise_out_of_memory();
+  for (i = 0; i < n; i++)
+    bufs[i] = (float *)Caml_ba_data_val(Field(_bufs, i));
+
+  return bufs;
+}
+
+CAMLprim value ocaml_gstreamer_dsp_mix(value _gains, value _srcs, value _dst,
+                                       value _len) {
+  CAMLparam3(_gains, _srcs, _dst);
+  intnat len = Long_val(_len);
+  int n = Wosize_val(_srcs);
+  float **srcs;
+  float *gains;
+  float *restrict dst;
+  const float *restrict src;
+  float g;
+  intnat i;
+  int k;
+
+  if (Wosize_val(_gains) / Double_wosize != n)
+    caml_invalid_argument("Dsp.mix: gains");
+  dsp_check(_dst, 0, sizeof(float), len, sizeof(float));
+  dst = (float *)Caml_ba_data_val(_dst);
+  srcs = dsp_buffers(_srcs, len);
+  gains = malloc(n * sizeof(float));
+  if (n && !gains) {
+    free(srcs);
+    caml_raise_out_of_memory();
+  }
+  for (k = 0; k < n; k++)
+    gains[k] = Double_field(_gains, k);
 
   caml_release_runtime_system();
-  gst_app_sink_set_max_buffers(as->appsink, n);
+  /* Accumulate one input at a time so that each pass vectorizes. */
+  memset(dst, 0, len * sizeof(float));
+  for (k = 0; k < n; k++) {
+    src = srcs[k];
+    g = gains[k];
+    for (i = 0; i < len; i++)
+      dst[i] += g * src[i];
+  }
   caml_acquire_runtime_system();
 
+  free(gains);
+  free(srcs);
+
   CAMLreturn(Val_unit);
 }
 
-/***** GstCaps *****/
-
-#define Caps_val(v) (*(GstCaps **)Data_custom_val(v))
+CAMLprim value ocaml_gstreamer_dsp_interleave(value _srcs, value _dst,
+                                              value _len) {
+  CAMLparam2(_srcs, _dst);
+  intnat len = Long_val(_len);
+  int chans = Wosize_val(_srcs);
+  float **srcs;
+  float *restrict dst;
+  const float *restrict src;
+  intnat i;
+  int c;
+
+  dsp_check(_dst, 0, sizeof(float), dsp_frames(len, chans), sizeof(float));
+  dst = (float *)Caml_ba_data_val(_dst);
+  srcs = dsp_buffers(_srcs, len);
 
-static void finalize_caps(value v) {
-  GstCaps *c = Caps_val(v);
-  gst_caps_unref(c);
-}
+  caml_release_runtime_system();
+  for (c = 0; c < chans; c++) {
+    src = srcs[c];
+    for (i = 0; i < len; i++)
+      dst[i * chans + c] = src[i];
+  }
+  caml_acquire_runtime_system();
 
-static struct custom_operations caps_ops = {
-    "ocaml_gstreamer_caps",   finalize_caps,
-    custom_compare_default,   custom_hash_default,
-    custom_serialize_default, custom_deserialize_default};
+  free(srcs);
 
-static value value_of_caps(GstCaps *c) {
-  value ans = caml_alloc_custom(&caps_ops, sizeof(GstCaps *), 0, 1);
-  Caps_val(ans) = c;
-  return ans;
+  CAMLreturn(Val_unit);
 }
 
-CAMLprim value ocaml_gstreamer_caps_to_string(value _c) {
-  CAMLparam1(_c);
-  CAMLlocal1(ans);
-  GstCaps *c = Caps_val(_c);
-  char *s;
+CAMLprim value ocaml_gstreamer_dsp_deinterleave(value _src, value _dsts,
+                                                value _len) {
+  CAMLparam2(_src, _dsts);
+  intnat len = Long_val(_len);
+  int chans = Wosize_val(_dsts);
+  float **dsts;
+  const float *restrict src;
+  float *restrict dst;
+  intnat i;
+  int c;
+
+  dsp_check(_src, 0, sizeof(float), dsp_frames(len, chans), sizeof(float));
+  src = (const float *)Caml_ba_data_val(_src);
+  dsts = dsp_buffers(_dsts, len);
 
   caml_release_runtime_system();
-  s = gst_caps_to_string(c);
+  for (c = 0; c < chans; c++) {
+    dst = dsts[c];
+    for (i = 0; i < len; i++)
+      dst[i] = src[i * chans + c];
+  }
   caml_acquire_runtime_system();
 
-  ans = caml_copy_string(s);
-  free(s);
+  free(dsts);
 
-  CAMLreturn(ans);
+  CAMLreturn(Val_unit);
 }
 
 /***** Typefind element *****/